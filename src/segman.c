@@ -7,14 +7,305 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <sixten_ass.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "segman.h"
 
+#ifndef SM_DECOMMIT_ADVICE
+#define SM_DECOMMIT_ADVICE MADV_DONTNEED
+#endif
+
+#ifdef SEGMAN_USE_PROFILE
+#include <execinfo.h>
+/* Profiled get entries keep their frame, see sm_prof_get(). */
+#define SM_GET_ENTRY __attribute__( ( noinline ) )
+#else
+#define SM_GET_ENTRY
+#endif
+
+#if defined( __linux__ ) && defined( __x86_64__ ) && !defined( SEGMAN_NO_RSEQ )
+#define SM_USE_RSEQ
+#include <sys/rseq.h>
+#endif
+
 
 st_struct( sm_info )
 {
     st_size_t header_size;
     st_size_t slot_area;
+    st_size_t color_cnt;
+};
+
+
+/** Provisioning states. */
+enum {
+    SM_PROV_IDLE,  /**< Nothing requested. */
+    SM_PROV_WANT,  /**< Segment requested by sm_get(). */
+    SM_PROV_BUSY,  /**< Segment under provisioning. */
+    SM_PROV_READY, /**< Segment provisioned (spare). */
+};
+
+
+/** Run Segment, with allocation bitmap. */
+st_struct( sm_run )
+{
+    sm_tail_t seg;      /**< Segment. */
+    sm_run_t  next;     /**< Next run Segment. */
+    st_size_t used_cnt; /**< Number of used slots. */
+    st_size_t word_cnt; /**< Bitmap size in words. */
+    uint64_t  map[];    /**< Allocation bitmap (1 for used). */
+};
+
+
+/** Epoch reader record. */
+st_struct( sm_reader )
+{
+    st_size_t state;       /**< Epoch and active bit (0 if free). */
+    char      pad[ 56 ]; /**< Cache line padding. */
+};
+
+
+/** Deferred slots per bag. */
+#define SM_BAG_SLOT_CNT 62
+
+/**
+ * Bag of deferred slots. Slots are not linked through their content,
+ * since readers might still access them.
+ */
+st_struct( sm_bag )
+{
+    sm_bag_t  next;                    /**< Next bag. */
+    st_size_t cnt;                     /**< Number of slots. */
+    st_t      slot[ SM_BAG_SLOT_CNT ]; /**< Deferred slots. */
+};
+
+
+/** Epoch based reclamation state. */
+st_struct( sm_ebr )
+{
+    st_size_t   epoch;                   /**< Global epoch (atomic). */
+    sm_bag_t    bag[ 3 ];                /**< Deferred slots per epoch. */
+    st_size_t   cnt[ 3 ];                /**< Deferred slot count per epoch. */
+    sm_bag_t    spare;                   /**< Unused bags. */
+    st_size_t   pending;                 /**< Deferred since last reclaim. */
+    sm_reader_s reader[ SM_READER_MAX ]; /**< Reader records. */
+};
+
+
+/** Traced Segment, with its trace Segment number. */
+st_struct( sm_trace_seg )
+{
+    sm_tail_t seg; /**< Segment. */
+    uint32_t  id;  /**< Segment number in trace. */
+};
+
+
+/** Trace recording state. */
+st_struct( sm_trace )
+{
+    int              fd;       /**< Trace file. */
+    st_size_t        size;     /**< Buffer size in events. */
+    st_size_t        cnt;      /**< Number of buffered events. */
+    uint64_t         start;    /**< Trace start time. */
+    sm_trace_seg_t   seg;      /**< Traced Segments (in Segment order). */
+    st_size_t        seg_cnt;  /**< Number of traced Segments. */
+    st_size_t        seg_size; /**< Traced Segment table size. */
+    uint32_t         seg_next; /**< Next Segment number. */
+    sm_trace_ev_s    ev[];     /**< Events (slot address in seg/index). */
+};
+
+
+/** Profiled call site. */
+st_struct( sm_site )
+{
+    uint64_t  hash;                     /**< Stack hash (0 for unused). */
+    st_size_t depth;                    /**< Stack depth. */
+    st_size_t live;                     /**< Live samples. */
+    st_size_t total;                    /**< All samples. */
+    void*     pc[ SM_PROFILE_DEPTH ];   /**< Return addresses. */
+};
+
+
+/** Sampled live slot. */
+st_struct( sm_sample )
+{
+    st_t      slot; /**< Slot (NULL for unused). */
+    sm_site_t site; /**< Call site of get. */
+};
+
+
+/** Sampling profiler state. */
+st_struct( sm_prof )
+{
+    st_size_t   interval;                    /**< Mean sampling interval. */
+    st_size_t   step;                        /**< Interval units per get. */
+    int64_t     countdown;                   /**< Units until next sample. */
+    uint64_t    seed;                        /**< Interval random state. */
+    sm_sample_t sample;                      /**< Live samples (linear probing). */
+    st_size_t   sample_size;                 /**< Sample table size (power of 2). */
+    st_size_t   sample_cnt;                  /**< Number of live samples. */
+    sm_site_s   other;                       /**< Sites that did not fit. */
+    sm_site_s   site[ SM_PROFILE_SITE_CNT ]; /**< Call sites (linear probing). */
+};
+
+
+/** Segment address range, for slot address translation. */
+st_struct( sm_seg_ref )
+{
+    uintptr_t base; /**< First slot. */
+    uintptr_t end;  /**< Slot area end. */
+    uint32_t  num;  /**< Segment number. */
+    sm_tail_t seg;  /**< Segment. */
+    st_size_t bit;  /**< Index of first slot over all Segments. */
+};
+
+
+/** Memory budget shared by Segmans. */
+st_struct_body( sm_budget )
+{
+    st_size_t       limit;    /**< Limit in bytes. */
+    st_size_t       used;     /**< Charged bytes (atomic). */
+    st_size_t       wait_ms;  /**< Wait time for release (0 to refuse). */
+    st_size_t       pool_cnt; /**< Number of attached Segmans (atomic). */
+    pthread_mutex_t lock;     /**< Release wait lock. */
+    pthread_cond_t  cond;     /**< Release signal. */
+};
+
+
+/** Address translation from Segman to its clone. */
+st_struct_body( sm_xlat )
+{
+    sm_seg_ref_t ref;    /**< Segments of original (sorted). */
+    st_size_t    cnt;    /**< Number of Segments. */
+    st_t         base[]; /**< Base of clone Segment (by Segment number). */
+};
+
+
+/** Range of decommitted free slots. */
+st_struct( sm_dec )
+{
+    sm_dec_t  next; /**< Next range. */
+    st_t      slot; /**< First slot. */
+    st_size_t cnt;  /**< Number of slots. */
+};
+
+
+/** Hash of slot address, for sample table. */
+#define SM_SLOT_HASH( s ) ( ( (uintptr_t)( s ) >> 4 ) * 0x9e3779b97f4a7c15ULL >> 16 )
+
+/** Slot bitmap access. */
+#define SM_BIT_SET( m, i ) ( ( m )[ ( i ) / 64 ] |= (uint64_t)1 << ( ( i ) % 64 ) )
+#define SM_BIT_GET( m, i ) ( ( ( m )[ ( i ) / 64 ] >> ( ( i ) % 64 ) ) & 1 )
+
+
+/** Segman extension state, for optional features. */
+st_struct_body( sm_ext )
+{
+    /* Coloring: */
+    st_size_t color; /**< Next Segment color (atomic). */
+
+    /* Provisioning: */
+    st_size_t       lowat;   /**< Low-water mark for free slots. */
+    st_size_t       state;   /**< Provisioning state (atomic). */
+    sm_tail_t       spare;   /**< Provisioned Segment. */
+    st_size_t       running; /**< Provisioning thread is running. */
+    pthread_t       thread;  /**< Provisioning thread. */
+    pthread_mutex_t lock;    /**< Provisioning request lock. */
+    pthread_cond_t  cond;    /**< Provisioning request signal. */
+
+    /* Object mode: */
+    sm_obj_fn ctor;     /**< Slot constructor. */
+    sm_obj_fn dtor;     /**< Slot destructor. */
+    st_size_t link_off; /**< Free link offset within slot. */
+
+    /* Registry: */
+    sm_t      sm;                  /**< Segman of extension. */
+    st_size_t reg;                 /**< Registered. */
+    sm_ext_t  reg_prev;            /**< Previous in registry. */
+    sm_ext_t  reg_next;            /**< Next in registry. */
+    char      name[ SM_NAME_MAX ]; /**< Name label. */
+    st_size_t seg_cnt;             /**< Number of Segments (atomic). */
+    st_size_t seg_bytes;           /**< Allocated bytes (atomic). */
+
+    /* Runs: */
+    sm_run_t run; /**< Run Segments. */
+
+    /* Deferred reclamation: */
+    sm_ebr_t ebr; /**< Reclamation state. */
+
+    /* Trace: */
+    sm_trace_t trace; /**< Trace recording state. */
+
+    /* Profile: */
+    sm_prof_t prof; /**< Sampling profiler state. */
+
+    /* Decommit: */
+    sm_dec_t  dec;        /**< Decommitted slot ranges. */
+    st_size_t dec_cnt;    /**< Number of decommitted slots. */
+    st_size_t idle_ms;    /**< Idle time before decommit (0 for none). */
+    uint64_t  idle_stamp; /**< Time of last activity seen. */
+    st_t      idle_head;  /**< Free list head at last activity. */
+    st_size_t idle_used;  /**< Used count at last activity. */
+    st_size_t idle_done;  /**< Decommitted since last activity. */
+
+    /* Waiting: */
+    st_size_t      waiters;   /**< Number of threads in sm_get_wait(). */
+    pthread_cond_t wait_cond; /**< Slot available signal. */
+    st_size_t      efd_on;    /**< Readiness eventfd is created. */
+    int            efd;       /**< Readiness eventfd. */
+
+    /* Budget: */
+    sm_budget_t budget;      /**< Shared memory budget. */
+    st_size_t   budget_used; /**< Bytes charged to budget (atomic). */
+
+    /* Stealing: */
+    st_size_t foreign; /**< Slots stolen from other Segmans (since reset). */
+
+    /* Zeroed mode: */
+    st_size_t zero_idle; /**< Clear free slots in sm_idle(). */
+    st_t      zero_next; /**< Next slot that has never been used. */
+    st_t      zero_end;  /**< End of never used slots. */
+    st_t      zero_head; /**< Cleared free slots. */
+    st_size_t zero_cnt;  /**< Number of cleared free slots. */
+};
+
+
+/** Pool registry. */
+static pthread_mutex_t sm_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static sm_ext_t        sm_reg_head = NULL;
+static st_size_t       sm_reg_on = 0;
+
+
+/** Per-CPU slot cache. */
+st_struct( sm_shard )
+{
+    st_size_t cur;    /**< Number of cached slots. */
+    st_size_t lock;   /**< Cache lock (without rseq). */
+    st_t      slot[]; /**< Cached slots. */
+};
+
+
+/** Per-CPU front end. */
+st_struct_body( sm_cpu )
+{
+    sm_t            sm;        /**< Common Segman. */
+    pthread_mutex_t lock;      /**< Common Segman lock. */
+    st_size_t       shard_cnt; /**< Number of caches (CPUs). */
+    st_size_t       cache_cnt; /**< Cache capacity. */
+    st_size_t       stride;    /**< Cache size in bytes. */
+    st_t            mem;       /**< Cache memory. */
+    st_t            shards;    /**< First cache (aligned). */
+    st_size_t       rseq;      /**< rseq is used. */
 };
 
 
@@ -22,8 +313,76 @@ st_struct( sm_info )
 static st_size_t sm_size_in_units( st_size_t block_size, st_size_t unit_size );
 static sm_info_s sm_host_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size );
 static sm_info_s sm_tail_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size );
-static st_none   sm_prepare_slot( sm_t sm );
-static st_none   sm_new_seg( sm_t sm );
+static st_none   sm_prepare_slot( sm_t sm, sm_ext_t obj );
+static inline st_t sm_get_slot( sm_t sm, sm_ext_t obj ) __attribute__( ( always_inline ) );
+static inline st_t sm_get_at( sm_t sm, void* caller ) __attribute__( ( always_inline ) );
+static inline sm_t sm_put_slot( sm_t sm, st_t slot, sm_ext_t obj ) __attribute__( ( always_inline ) );
+static st_none   sm_reset_seg( sm_t sm, sm_tail_t seg );
+static st_size_t sm_tail_slots( sm_t sm );
+static st_size_t sm_color_next( sm_t sm );
+static sm_tail_t sm_alloc_seg( sm_t sm, st_size_t slot_cnt );
+static st_none   sm_link_seg( sm_t sm, sm_tail_t seg );
+static st_size_t sm_new_seg( sm_t sm );
+static st_none   sm_free_seg( sm_t sm, sm_tail_t seg );
+static st_none   sm_dtor_seg( sm_t sm, sm_tail_t seg );
+static st_none   sm_seg_span( sm_t sm, sm_tail_t seg, st_t* mem, st_size_t* size );
+static st_size_t sm_commit_seg( sm_t sm, sm_tail_t seg, st_size_t flags );
+static sm_ext_t  sm_ext_get( sm_t sm );
+static st_none   sm_ext_del( sm_t sm );
+static st_size_t sm_budget_charge( sm_t sm, st_size_t size );
+static st_none   sm_budget_release( sm_t sm, st_size_t size );
+static st_none   sm_budget_leave( sm_t sm );
+static st_size_t sm_trim_empty( sm_t sm );
+static st_none   sm_wake( sm_t sm );
+static inline st_size_t sm_is_empty( sm_t sm );
+static st_none   sm_wake_added( sm_t sm, st_size_t empty );
+static st_none   sm_low_water( sm_t sm );
+static st_size_t sm_use_spare( sm_t sm );
+static st_t      sm_provision_main( st_t arg );
+static st_size_t sm_ebr_reclaim( sm_t sm );
+static st_none   sm_ebr_clear( sm_ebr_t ebr, st_size_t e );
+static sm_run_t  sm_run_new( sm_t sm );
+static st_none   sm_run_clear( sm_run_t run );
+static st_id_t   sm_run_find( sm_run_t run, st_size_t n );
+static st_none   sm_run_mark( sm_run_t run, st_size_t idx, st_size_t n, st_size_t used );
+static st_size_t sm_run_used( sm_run_t run, st_size_t idx, st_size_t n );
+#ifdef SEGMAN_USE_TRACE
+static uint64_t  sm_trace_time( void );
+static st_none   sm_trace_add( sm_t sm, st_size_t type, st_t slot );
+#endif
+static st_size_t sm_trace_write( sm_t sm );
+static st_size_t sm_trace_seg_add( sm_t sm );
+static st_none   sm_trace_seg_rem( sm_trace_t trc, sm_tail_t seg );
+static st_none   sm_trace_del( sm_trace_t trc );
+#ifdef SEGMAN_USE_PROFILE
+static st_none   sm_prof_get( sm_t sm, st_t slot, void* caller ) __attribute__( ( noinline ) );
+static st_none   sm_prof_put( sm_prof_t prof, st_t slot );
+static st_none   sm_prof_next( sm_prof_t prof );
+static sm_site_t sm_prof_site( sm_prof_t prof, void** pc, st_size_t depth );
+static st_size_t sm_prof_insert( sm_prof_t prof, st_t slot, sm_site_t site );
+static st_none   sm_prof_clear( sm_prof_t prof );
+static int       sm_site_cmp( const void* a, const void* b );
+#endif
+static sm_seg_ref_t sm_seg_refs( sm_t sm, sm_tail_t last, st_size_t* cnt );
+static sm_seg_ref_t sm_seg_find( sm_seg_ref_t ref, st_size_t cnt, uintptr_t addr );
+static int       sm_seg_ref_cmp( const void* a, const void* b );
+static st_size_t sm_recommit( sm_t sm );
+static st_none   sm_dec_clear( sm_ext_t ext );
+static st_none   sm_decommit_area( uintptr_t lo, uintptr_t hi, st_size_t page );
+static inline st_none sm_clear_slot( st_t slot, st_size_t size );
+static st_size_t sm_zero_batch( sm_t sm );
+static st_size_t sm_zero_splice( sm_t sm );
+static uint64_t  sm_time_ms( void );
+static st_size_t sm_write( int fd, const void* buf, st_size_t size );
+static st_none   sm_reg_add( sm_t sm );
+static st_none   sm_reg_count( sm_t sm, sm_tail_t seg, st_size_t size, st_size_t add );
+static st_none   sm_reg_rem( sm_ext_t ext );
+static st_none   sm_reg_write( int fd, st_size_t format, sm_t sm, st_size_t first );
+static sm_shard_t sm_shard( sm_cpu_t smc, st_size_t cpu );
+static st_size_t  sm_shard_pop( sm_cpu_t smc, st_t* slot );
+static st_size_t  sm_shard_push( sm_cpu_t smc, st_t slot );
+static st_t       sm_cpu_refill( sm_cpu_t smc );
+static st_none    sm_cpu_drain( sm_cpu_t smc, st_t slot );
 static st_none   sm_init_host( sm_t      sm,
                                st_t      slot_mem,
                                st_size_t slot_cnt,
@@ -45,6 +404,9 @@ sm_t sm_new( st_size_t slot_cnt, st_size_t slot_size )
     info = sm_host_info( slot_cnt, 0, slot_size );
 
     mem = st_alloc( info.header_size + info.slot_area );
+    if ( mem == NULL ) {
+        return NULL;
+    }
     sm = mem + info.slot_area;
     sm_use( sm, mem, slot_cnt, slot_size );
 
@@ -60,6 +422,9 @@ sm_t sm_new_block( st_size_t block_size, st_size_t slot_size )
     info = sm_host_info( 0, block_size, slot_size );
 
     mem = st_alloc( info.header_size + info.slot_area );
+    if ( mem == NULL ) {
+        return NULL;
+    }
     return sm_use_block( mem, block_size, slot_size );
 }
 
@@ -95,16 +460,38 @@ sm_t sm_use_block( st_t mem, st_size_t block_size, size_t slot_size )
 
 sm_t sm_reset( sm_t sm )
 {
-    sm_tail_t cur;
+    st_size_t empty;
 
-    cur = sm->host.next;
+    empty = sm_is_empty( sm );
 
-    while ( cur ) {
-        cur->init_cnt = 0;
-        cur = cur->next;
-    }
+    /*
+     * Segments after the tail are always stale, hence Tail Segments
+     * are reset when sm_get() takes them into use.
+     */
+    sm_reset_seg( sm, &sm->host );
 
-    sm->host.init_cnt = 0;
+    if ( sm->ext ) {
+        sm_run_t run;
+        for ( run = sm->ext->run; run; run = run->next ) {
+            sm_run_clear( run );
+        }
+        sm_dec_clear( sm->ext );
+        sm->ext->foreign = 0;
+        sm->ext->zero_next = NULL;
+        sm->ext->zero_head = NULL;
+        sm->ext->zero_cnt = 0;
+#ifdef SEGMAN_USE_PROFILE
+        if ( sm->ext->prof ) {
+            sm_prof_clear( sm->ext->prof );
+        }
+#endif
+        if ( sm->ext->ebr ) {
+            sm->ext->ebr->pending = 0;
+            sm_ebr_clear( sm->ext->ebr, 0 );
+            sm_ebr_clear( sm->ext->ebr, 1 );
+            sm_ebr_clear( sm->ext->ebr, 2 );
+        }
+    }
 
     sm->used_cnt = 0;
     /*
@@ -116,13 +503,27 @@ sm_t sm_reset( sm_t sm )
     sm->tail = &sm->host;
     sm->head = sm->tail->base;
 
+    sm_wake_added( sm, empty );
+
     return sm;
 }
 
 
 sm_t sm_del( sm_t sm )
 {
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+        sm_dtor_seg( sm, &sm->host );
+    }
+
     sm_del_tail( sm );
+
+    if ( sm->flags & SM_FLAG_LOCKED ) {
+        st_t      mem;
+        st_size_t size;
+        sm_seg_span( sm, &sm->host, &mem, &size );
+        munlock( mem, size );
+    }
+
     st_del( sm->host.base );
     return NULL;
 }
@@ -133,338 +534,4690 @@ sm_t sm_del_tail( sm_t sm )
     sm_tail_t cur;
     sm_tail_t next;
 
+    if ( sm->ext ) {
+        /* Leave registry before any memory is released. */
+        sm_reg_rem( sm->ext );
+    }
+
+    if ( sm->flags & SM_FLAG_TRACE ) {
+        /* Segments are needed for address translation. */
+        sm_trace_stop( sm );
+    }
+
     cur = sm->host.next;
 
     while ( cur ) {
         next = cur->next;
-        st_del( cur );
+        sm_free_seg( sm, cur );
         cur = next;
     }
 
     sm->host.next = NULL;
 
+    sm_ext_del( sm );
+
     return NULL;
 }
 
 
-st_size_t sm_set_resize_factor( sm_t sm, st_size_t factor )
+sm_t sm_clone( sm_t sm, sm_xlat_t* xlat )
 {
-    if ( factor == 0 || ( factor * sm->slot_cnt / 100 ) >= SM_MIN_SLOT_CNT ) {
-        sm->resize = factor;
-        return 1;
+    sm_t         dst;
+    sm_xlat_t    x;
+    sm_seg_ref_t ref;
+    sm_tail_t    cur;
+    sm_tail_t    seg;
+    sm_tail_t    prev;
+    st_t         mem;
+    st_t         slot;
+    st_t         lo;
+    st_t         hi;
+    st_size_t    size;
+    st_size_t    cnt;
+    st_size_t    off;
+    st_size_t    i;
+
+    if ( xlat ) {
+        *xlat = NULL;
+    }
+
+    if ( sm->ext
+         && ( sm->ext->run || sm->ext->dec || sm->ext->zero_head || sm->ext->foreign
+              || ( sm->ext->ebr && sm->ext->ebr->cnt[ 0 ] + sm->ext->ebr->cnt[ 1 ] + sm->ext->ebr->cnt[ 2 ] ) ) ) {
+        /* Slots outside the free list are not tracked by the copy. */
+        return NULL;
+    }
+
+    ref = sm_seg_refs( sm, NULL, &cnt );
+    if ( ref == NULL ) {
+        return NULL;
+    }
+
+    x = st_alloc( sizeof( sm_xlat_s ) + cnt * sizeof( st_t ) );
+    if ( x == NULL ) {
+        st_del( ref );
+        return NULL;
+    }
+    x->ref = ref;
+    x->cnt = cnt;
+
+    if ( sm->block_size ) {
+        dst = sm_new_block( sm->block_size, sm->slot_size );
     } else {
-        return 0;
+        dst = sm_new( sm->slot_cnt, sm->slot_size );
+    }
+
+    if ( dst == NULL || dst->host.tail_cnt != sm->host.tail_cnt ) {
+        /* Host with user provided layout. */
+        if ( dst ) {
+            sm_del( dst );
+        }
+        sm_xlat_del( x );
+        return NULL;
     }
-}
 
+    dst->flags = sm->flags & ( SM_FLAG_FIXED | SM_FLAG_ZERO );
+
+    memcpy( dst->host.base, sm->host.base, sm->host.tail_cnt * sm->slot_size );
+    dst->host.init_cnt = sm->host.init_cnt;
+    x->base[ 0 ] = dst->host.base;
+
+    /* Tail Segments are copied as whole, including header and color. */
+    prev = &dst->host;
+    i = 1;
+    for ( cur = sm->host.next; cur; cur = cur->next ) {
+        sm_seg_span( sm, cur, &mem, &size );
+        seg = st_alloc( size );
+        if ( seg == NULL ) {
+            sm_del( dst );
+            sm_xlat_del( x );
+            return NULL;
+        }
 
-st_size_t sm_head_segment_size( st_size_t slot_cnt, st_size_t slot_size )
-{
-    return ( slot_cnt * slot_size ) + sizeof( sm_s );
-}
+        memcpy( seg, cur, size );
+        seg->base = (st_t)seg + ( cur->base - (st_t)cur );
+        seg->next = NULL;
+        prev->next = seg;
+        prev = seg;
 
+        if ( dst->ext ) {
+            /* Copy joined registry in sm_new(). */
+            sm_reg_count( dst, seg, size, 1 );
+        }
 
-st_size_t sm_head_segment_size_block( st_size_t slot_cnt, st_size_t slot_size )
-{
-    st_size_t header_slots;
-    header_slots = sm_size_in_units( sizeof( sm_s ), slot_size );
-    return ( header_slots + slot_cnt ) * slot_size;
-}
+        if ( cur == sm->tail ) {
+            dst->tail = seg;
+        }
+        x->base[ i++ ] = seg->base;
+    }
 
+    if ( sm->flags & ( SM_FLAG_OBJECT | SM_FLAG_ZERO ) ) {
+        if ( sm_ext_get( dst ) == NULL ) {
+            sm_del( dst );
+            sm_xlat_del( x );
+            return NULL;
+        }
+    }
 
-st_size_t sm_handle_offset( st_size_t slot_cnt, st_size_t slot_size )
-{
-    return slot_cnt * slot_size;
-}
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+        /* Slots are copied in constructed state. */
+        dst->ext->ctor = sm->ext->ctor;
+        dst->ext->dtor = sm->ext->dtor;
+        dst->ext->link_off = sm->ext->link_off;
+        dst->flags |= SM_FLAG_OBJECT;
+        off = sm->ext->link_off;
+    } else {
+        off = 0;
+    }
 
+    if ( sm->flags & SM_FLAG_ZERO ) {
+        dst->ext->zero_idle = sm->ext->zero_idle;
+        if ( sm->ext->zero_next ) {
+            /* End is past the slot area, translate the last slot. */
+            dst->ext->zero_end = sm_xlat( x, sm->ext->zero_end - sm->slot_size ) + sm->slot_size;
+            dst->ext->zero_next = dst->ext->zero_end - ( sm->ext->zero_end - sm->ext->zero_next );
+        }
+    }
 
-st_size_t sm_slot_size( sm_t sm )
-{
-    return sm->slot_size;
-}
+    dst->used_cnt = sm->used_cnt;
+    dst->free_cnt = sm->free_cnt;
+    dst->resize = sm->resize;
+    dst->head = sm_xlat( x, sm->head );
 
+#ifdef SEGMAN_USE_HOOKS
+    dst->get_cb = sm->get_cb;
+    dst->put_cb = sm->put_cb;
+#endif
 
-st_size_t sm_total_count( sm_t sm )
-{
-    return sm->used_cnt + sm->free_cnt;
-}
+    /*
+     * Rebase free list links. Uninitialized slots of the tail Segment
+     * have no link yet.
+     */
+    lo = dst->tail->base + dst->tail->init_cnt * dst->slot_size;
+    hi = dst->tail->base + dst->tail->tail_cnt * dst->slot_size;
+    slot = dst->head;
+    for ( i = 0; i < dst->free_cnt && slot; i++ ) {
+        if ( slot >= lo && slot < hi ) {
+            break;
+        }
+        *( (st_p)( slot + off ) ) = sm_xlat( x, *( (st_p)( slot + off ) ) );
+        slot = *( (st_p)( slot + off ) );
+    }
 
+    if ( xlat ) {
+        *xlat = x;
+    } else {
+        sm_xlat_del( x );
+    }
 
-st_size_t sm_used_count( sm_t sm )
-{
-    return sm->used_cnt;
+    return dst;
 }
 
 
-st_size_t sm_free_count( sm_t sm )
+st_t sm_xlat( sm_xlat_t xlat, st_t ptr )
 {
-    return sm->free_cnt;
-}
+    sm_seg_ref_t ref;
 
+    if ( ptr == NULL ) {
+        return NULL;
+    }
 
-st_size_t sm_host_size( void )
-{
-    return sizeof( sm_s );
+    ref = sm_seg_find( xlat->ref, xlat->cnt, (uintptr_t)ptr );
+    if ( ref == NULL ) {
+        return ptr;
+    }
+
+    return xlat->base[ ref->num ] + ( (uintptr_t)ptr - ref->base );
 }
 
 
-st_size_t sm_tail_size( void )
+sm_xlat_t sm_xlat_del( sm_xlat_t xlat )
 {
-    return sizeof( sm_tail_s );
+    st_del( xlat->ref );
+    st_del( xlat );
+    return NULL;
 }
 
 
-st_t sm_get( sm_t sm )
+st_size_t sm_steal( sm_t dst, sm_t src, st_size_t n )
 {
+    st_size_t off;
+    st_size_t linked;
+    st_size_t empty;
+    st_size_t i;
+    st_t      first;
+    st_t      last;
+
+    if ( dst == src || dst->slot_size != src->slot_size
+         || ( dst->flags & SM_FLAG_OBJECT ) != ( src->flags & SM_FLAG_OBJECT ) ) {
+        return 0;
+    }
 
-#ifdef SEGMAN_USE_HOOKS
-    if ( sm->get_cb ) {
-        sm->get_cb( sm, NULL );
+    if ( src->flags & SM_FLAG_OBJECT ) {
+        if ( dst->ext->link_off != src->ext->link_off ) {
+            return 0;
+        }
+        off = src->ext->link_off;
+    } else {
+        off = 0;
     }
-#endif
 
-retry:
+    /* Uninitialized slots of tail Segment are at the end of list. */
+    linked = src->free_cnt - ( src->tail->tail_cnt - src->tail->init_cnt );
+    if ( n > linked ) {
+        n = linked;
+    }
 
-    if ( sm->tail->init_cnt < sm->tail->tail_cnt ) {
-        sm_prepare_slot( sm );
+    if ( n == 0 || sm_ext_get( dst ) == NULL ) {
+        return 0;
     }
 
-    st_t ret = NULL;
+    first = src->head;
+    last = first;
+    for ( i = 1; i < n; i++ ) {
+        last = *( (st_p)( last + off ) );
+    }
 
-    if ( sm->free_cnt > 0 ) {
+    if ( src->flags & SM_FLAG_ZERO ) {
+        /* Never used slots might be moved. */
+        src->ext->zero_next = NULL;
+    }
 
-        ret = sm->head;
+    /* Unlink from source. */
+    src->free_cnt -= n;
+    if ( src->free_cnt > 0 ) {
+        src->head = *( (st_p)( last + off ) );
+    } else {
+        src->head = NULL;
+    }
 
-        sm->used_cnt++;
-        sm->free_cnt--;
+    /* Splice to destination head. */
+    empty = sm_is_empty( dst );
+    *( (st_p)( last + off ) ) = dst->head;
+    dst->head = first;
+    dst->free_cnt += n;
 
-        if ( sm->free_cnt > 0 ) {
+    /* Slots are outside of dst Segments. */
+    dst->ext->foreign += n;
 
-            /* Get the link info from returned slot. */
-            sm->head = *( (st_p)sm->head );
+    sm_wake_added( dst, empty );
 
-        } else {
+    return n;
+}
 
-            /* No more slots, out-of-mem. */
-            sm->head = NULL;
-        }
 
-    } else if ( sm->tail->next ) {
+st_size_t sm_merge( sm_t dst, sm_t src )
+{
+    sm_tail_t first;
+    sm_tail_t cur;
+    st_t      mem;
+    st_size_t size;
+    st_size_t bytes;
+    st_size_t empty;
+
+    if ( dst == src || dst->slot_size != src->slot_size || dst->block_size != src->block_size
+         || ( dst->flags & ( SM_FLAG_OBJECT | SM_FLAG_ZERO ) )
+                != ( src->flags & ( SM_FLAG_OBJECT | SM_FLAG_ZERO ) )
+         || src->used_cnt != 0 || ( src->ext && src->ext->run ) ) {
+        /* Runs are allocated from their own Segments. */
+        return 0;
+    }
 
-        /* Pre-existing Tail Segment (left from sm_reset). */
-        sm->tail = sm->tail->next;
-        sm->head = sm->tail->base;
-        sm->free_cnt += sm->tail->tail_cnt;
-        goto retry;
+    if ( ( src->flags & SM_FLAG_OBJECT )
+         && ( dst->ext->ctor != src->ext->ctor || dst->ext->dtor != src->ext->dtor
+              || dst->ext->link_off != src->ext->link_off ) ) {
+        return 0;
+    }
 
-    } else if ( sm->resize != 0 ) {
+    first = src->host.next;
+    if ( first == NULL ) {
+        return 1;
+    }
 
-        sm_new_seg( sm );
-        goto retry;
+    if ( src->flags & SM_FLAG_TRACE ) {
+        /* Events refer to the Segments of source, which leave with Host only. */
+        sm_trace_flush( src );
+        for ( cur = first; cur; cur = cur->next ) {
+            sm_trace_seg_rem( src->ext->trace, cur );
+        }
     }
 
-    return ret;
-}
+    /* Source is left with Host only. */
+    sm_reset( src );
+    src->host.next = NULL;
 
+    bytes = 0;
+    for ( cur = first; cur; cur = cur->next ) {
+        sm_seg_span( src, cur, &mem, &size );
+        bytes += size;
+        if ( src->ext ) {
+            sm_reg_count( src, cur, size, 0 );
+        }
+        if ( dst->ext ) {
+            sm_reg_count( dst, cur, size, 1 );
+        }
+    }
 
-sm_t sm_put( sm_t sm, st_t slot )
-{
+    if ( src->ext && src->ext->budget ) {
+        sm_budget_release( src, bytes );
+    }
 
-#ifdef SEGMAN_USE_HOOKS
-    if ( sm->put_cb ) {
-        sm->put_cb( sm, slot );
+    if ( dst->ext && dst->ext->budget ) {
+        /* Memory exists already, hence it is charged over the limit. */
+        __atomic_add_fetch( &dst->ext->budget->used, bytes, __ATOMIC_RELAXED );
+        __atomic_add_fetch( &dst->ext->budget_used, bytes, __ATOMIC_RELAXED );
     }
-#endif
 
-    if ( sm->used_cnt == 0 ) {
-        return NULL;
+    /* Segments are taken into use (and reset) as pre-existing Segments. */
+    empty = sm_is_empty( dst );
+    for ( cur = dst->tail; cur->next; cur = cur->next ) {
     }
+    cur->next = first;
 
-    if ( sm->head != NULL ) {
+    sm_wake_added( dst, empty );
 
-        /* Store index of previous free slot to freed slot. */
-        *( (st_p)slot ) = sm->head;
+    return 1;
+}
 
-        /* Update free slot to freed slot. */
-        sm->head = slot;
 
+st_size_t sm_set_resize_factor( sm_t sm, st_size_t factor )
+{
+    if ( factor == 0 || ( factor * sm->slot_cnt / 100 ) >= SM_MIN_SLOT_CNT ) {
+        sm->resize = factor;
+        return 1;
     } else {
-
-        /*
+        return 0;
+    }
+}
+
+
+st_size_t sm_reserve( sm_t sm, st_size_t n_slots, st_size_t flags )
+{
+    sm_tail_t cur;
+    sm_tail_t seg;
+    st_size_t avail;
+    st_size_t empty;
+    st_size_t slot_cnt;
+
+    empty = sm_is_empty( sm );
+
+    /* Count slots in current and pre-existing Segments. */
+    cur = sm->tail;
+    avail = sm_free_count( sm );
+    while ( cur->next ) {
+        cur = cur->next;
+        avail += cur->tail_cnt;
+    }
+
+    while ( avail < n_slots ) {
+        slot_cnt = sm_tail_slots( sm );
+        if ( ( flags & SM_RESERVE_SINGLE ) && n_slots - avail > slot_cnt ) {
+            slot_cnt = n_slots - avail;
+        }
+        seg = sm_alloc_seg( sm, slot_cnt );
+        if ( seg == NULL ) {
+            return 0;
+        }
+        cur->next = seg;
+        cur = seg;
+        avail += seg->tail_cnt;
+        sm_wake_added( sm, empty );
+        empty = 0;
+    }
+
+    if ( flags & SM_RESERVE_LOCK ) {
+        sm->flags |= SM_FLAG_LOCKED;
+    }
+
+    if ( flags & ( SM_RESERVE_PREFAULT | SM_RESERVE_LOCK ) ) {
+        for ( cur = sm->tail; cur; cur = cur->next ) {
+            if ( !sm_commit_seg( sm, cur, flags ) ) {
+                return 0;
+            }
+        }
+    }
+
+    if ( flags & SM_RESERVE_FIXED ) {
+        sm->flags |= SM_FLAG_FIXED;
+    }
+
+    return 1;
+}
+
+
+st_size_t sm_set_low_water( sm_t sm, st_size_t lowat )
+{
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    sm->ext->lowat = lowat;
+
+    if ( lowat != 0 ) {
+        sm->flags |= SM_FLAG_LOWAT;
+        sm_low_water( sm );
+    } else {
+        sm->flags &= ~SM_FLAG_LOWAT;
+    }
+
+    return 1;
+}
+
+
+st_size_t sm_maintain( sm_t sm )
+{
+    sm_ext_t  ext;
+    sm_tail_t seg;
+    st_size_t state;
+    st_size_t flags;
+
+    ext = sm->ext;
+
+    if ( ext == NULL ) {
+        return 1;
+    }
+
+    /* Claim the request. */
+    state = SM_PROV_WANT;
+    if ( !__atomic_compare_exchange_n(
+             &ext->state, &state, SM_PROV_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) {
+        return 1;
+    }
+
+    flags = SM_RESERVE_PREFAULT;
+    if ( sm->flags & SM_FLAG_LOCKED ) {
+        flags |= SM_RESERVE_LOCK;
+    }
+
+    seg = sm_alloc_seg( sm, sm_tail_slots( sm ) );
+
+    if ( seg == NULL || !sm_commit_seg( sm, seg, flags ) ) {
+        if ( seg ) {
+            sm_free_seg( sm, seg );
+        }
+        /* Next sm_get() below low-water mark will request again. */
+        __atomic_store_n( &ext->state, SM_PROV_IDLE, __ATOMIC_RELEASE );
+        return 0;
+    }
+
+    ext->spare = seg;
+    __atomic_store_n( &ext->state, SM_PROV_READY, __ATOMIC_RELEASE );
+
+    return 1;
+}
+
+
+st_size_t sm_provision_start( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm_ext_get( sm );
+
+    if ( ext == NULL ) {
+        return 0;
+    }
+
+    if ( ext->running ) {
+        return 1;
+    }
+
+    ext->running = 1;
+
+    if ( pthread_create( &ext->thread, NULL, sm_provision_main, sm ) != 0 ) {
+        ext->running = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+st_none sm_provision_stop( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm->ext;
+
+    if ( ext == NULL || !ext->running ) {
+        return;
+    }
+
+    pthread_mutex_lock( &ext->lock );
+    ext->running = 0;
+    pthread_cond_signal( &ext->cond );
+    pthread_mutex_unlock( &ext->lock );
+
+    pthread_join( ext->thread, NULL );
+}
+
+
+st_size_t sm_decommit( sm_t sm )
+{
+    sm_ext_t     ext;
+    sm_seg_ref_t ref;
+    sm_seg_ref_t r;
+    sm_dec_t     dec;
+    sm_tail_t    cur;
+    uint64_t*    map;
+    uint64_t*    gone;
+    st_size_t    ref_cnt;
+    st_size_t    word_cnt;
+    st_size_t    page;
+    st_size_t    uninit;
+    st_size_t    tail_lo;
+    st_size_t    tail_hi;
+    st_size_t    limit;
+    st_size_t    free_cnt;
+    st_size_t    first;
+    st_size_t    last;
+    st_size_t    idx;
+    st_size_t    i;
+    st_size_t    j;
+    uintptr_t    p;
+    uintptr_t    lo;
+    uintptr_t    hi;
+    uintptr_t    run;
+    st_t         slot;
+    st_t         next;
+
+    if ( sm->flags & ( SM_FLAG_OBJECT | SM_FLAG_LOCKED ) ) {
+        /* Constructed or locked slots are kept. */
+        return 0;
+    }
+
+    ext = sm_ext_get( sm );
+    if ( ext == NULL || ext->foreign ) {
+        /* Stolen slots are not within the Segments. */
+        return 0;
+    }
+
+    page = sysconf( _SC_PAGESIZE );
+
+    /* Pre-existing Segments are initialized when taken into use. */
+    for ( cur = sm->tail->next; cur; cur = cur->next ) {
+        sm_decommit_area(
+            (uintptr_t)cur->base, (uintptr_t)cur->base + cur->tail_cnt * sm->slot_size, page );
+    }
+
+    ref = sm_seg_refs( sm, sm->tail, &ref_cnt );
+    if ( ref == NULL ) {
+        return 0;
+    }
+
+    word_cnt = 0;
+    for ( i = 0; i < ref_cnt; i++ ) {
+        word_cnt += ref[ i ].seg->tail_cnt;
+    }
+    word_cnt = ( word_cnt + 63 ) / 64;
+
+    map = st_alloc( 2 * word_cnt * sizeof( uint64_t ) );
+    if ( map == NULL ) {
+        st_del( ref );
+        return 0;
+    }
+
+    memset( map, 0, 2 * word_cnt * sizeof( uint64_t ) );
+    gone = map + word_cnt;
+
+    /* Mark free slots: linked, uninitialized, and decommitted. */
+    uninit = sm->tail->tail_cnt - sm->tail->init_cnt;
+
+    slot = sm->head;
+    for ( i = 0; i < sm->free_cnt - uninit; i++ ) {
+        r = sm_seg_find( ref, ref_cnt, (uintptr_t)slot );
+        if ( r == NULL ) {
+            /* Slot of other Segman, free list is kept as is. */
+            st_del( map );
+            st_del( ref );
+            return 0;
+        }
+        idx = r->bit + ( (uintptr_t)slot - r->base ) / sm->slot_size;
+        SM_BIT_SET( map, idx );
+        slot = *( (st_p)slot );
+    }
+
+    r = sm_seg_find( ref, ref_cnt, (uintptr_t)sm->tail->base );
+    tail_lo = r->bit + sm->tail->init_cnt;
+    tail_hi = r->bit + sm->tail->tail_cnt;
+    for ( idx = tail_lo; idx < tail_hi; idx++ ) {
+        SM_BIT_SET( map, idx );
+    }
+
+    for ( dec = ext->dec; dec; dec = dec->next ) {
+        r = sm_seg_find( ref, ref_cnt, (uintptr_t)dec->slot );
+        idx = r->bit + ( (uintptr_t)dec->slot - r->base ) / sm->slot_size;
+        for ( j = 0; j < dec->cnt; j++, idx++ ) {
+            SM_BIT_SET( map, idx );
+            SM_BIT_SET( gone, idx );
+        }
+    }
+
+    /* Release runs of pages that have only free slots. */
+    for ( i = 0; i < ref_cnt; i++ ) {
+
+        r = &ref[ i ];
+
+        if ( r->seg == &sm->host ) {
+            /* Host memory might be owned by the user (sm_use()). */
+            continue;
+        }
+
+        lo = ( r->base + page - 1 ) & ~( page - 1 );
+        hi = r->end & ~( page - 1 );
+        run = 0;
+
+        for ( p = lo; p < hi; p += page ) {
+
+            first = ( p - r->base ) / sm->slot_size;
+            last = ( p + page - 1 - r->base ) / sm->slot_size;
+
+            for ( j = first; j <= last && SM_BIT_GET( map, r->bit + j ); j++ )
+                ;
+
+            if ( j > last ) {
+                if ( run == 0 ) {
+                    run = p;
+                }
+                for ( j = first; j <= last; j++ ) {
+                    idx = r->bit + j;
+                    if ( idx < tail_lo || idx >= tail_hi ) {
+                        /* Uninitialized slots stay lazy. */
+                        SM_BIT_SET( gone, idx );
+                    }
+                }
+            } else if ( run ) {
+                sm_decommit_area( run, p, page );
+                run = 0;
+            }
+        }
+
+        if ( run ) {
+            sm_decommit_area( run, hi, page );
+        }
+    }
+
+    /*
+     * Rebuild free list, lowest address first, and collect
+     * decommitted slots to ranges. The list continues to the
+     * uninitialized slots of tail.
+     */
+    sm_dec_clear( ext );
+
+    next = uninit ? sm->tail->base + sm->tail->init_cnt * sm->slot_size : NULL;
+    free_cnt = uninit;
+
+    for ( i = ref_cnt; i-- > 0; ) {
+
+        r = &ref[ i ];
+        limit = ( r->seg == sm->tail ) ? sm->tail->init_cnt : r->seg->tail_cnt;
+        dec = NULL;
+
+        for ( j = limit; j-- > 0; ) {
+
+            idx = r->bit + j;
+
+            if ( !SM_BIT_GET( map, idx ) ) {
+                dec = NULL;
+                continue;
+            }
+
+            slot = r->seg->base + j * sm->slot_size;
+
+            if ( SM_BIT_GET( gone, idx ) ) {
+
+                if ( dec == NULL ) {
+                    dec = st_alloc( sizeof( sm_dec_s ) );
+                    if ( dec ) {
+                        dec->next = ext->dec;
+                        dec->cnt = 0;
+                        ext->dec = dec;
+                    }
+                }
+
+                if ( dec ) {
+                    dec->slot = slot;
+                    dec->cnt++;
+                    ext->dec_cnt++;
+                    continue;
+                }
+            }
+
+            /* Link (also released slot, if range allocation failed). */
+            *( (st_p)slot ) = next;
+            next = slot;
+            free_cnt++;
+            dec = NULL;
+        }
+    }
+
+    sm->head = next;
+    sm->free_cnt = free_cnt;
+
+    /* Never used slots might not be taken in order anymore. */
+    ext->zero_next = NULL;
+
+    st_del( map );
+    st_del( ref );
+
+    return 1;
+}
+
+
+st_size_t sm_set_idle_decommit( sm_t sm, st_size_t idle_ms )
+{
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    sm->ext->idle_ms = idle_ms;
+    sm->ext->idle_stamp = sm_time_ms();
+    sm->ext->idle_head = sm->head;
+    sm->ext->idle_used = sm->used_cnt;
+    sm->ext->idle_done = 0;
+
+    return 1;
+}
+
+
+st_size_t sm_idle( sm_t sm )
+{
+    sm_ext_t  ext;
+    sm_tail_t cur;
+    uint64_t  now;
+    st_size_t avail;
+    st_size_t ret;
+
+    ext = sm->ext;
+
+    if ( ext == NULL ) {
+        return 0;
+    }
+
+    ret = 0;
+
+    if ( ext->idle_ms ) {
+
+        now = sm_time_ms();
+
+        if ( sm->head != ext->idle_head || sm->used_cnt != ext->idle_used ) {
+
+            /* Activity since last call. */
+            ext->idle_stamp = now;
+            ext->idle_head = sm->head;
+            ext->idle_used = sm->used_cnt;
+            ext->idle_done = 0;
+
+        } else if ( !ext->idle_done && now - ext->idle_stamp >= ext->idle_ms ) {
+
+            ret = sm_decommit( sm );
+
+            /* Free list was rebuilt. */
+            ext->idle_head = sm->head;
+            ext->idle_done = 1;
+        }
+    }
+
+    if ( ret == 0 && ext->zero_idle && sm_zero_batch( sm ) ) {
+        /* Moving slots is not activity. */
+        ext->idle_head = sm->head;
+        ret = 1;
+    }
+
+    if ( ext->budget
+         && __atomic_load_n( &ext->budget_used, __ATOMIC_RELAXED )
+                > ext->budget->limit / __atomic_load_n( &ext->budget->pool_cnt, __ATOMIC_RELAXED ) ) {
+
+        /* Above the share of budget, trim if a Segment can be free. */
+        avail = sm_free_count( sm ) + sm_spare_count( sm );
+        for ( cur = sm->tail->next; cur; cur = cur->next ) {
+            avail += cur->tail_cnt;
+        }
+
+        if ( avail >= sm_tail_slots( sm ) && sm_trim( sm ) ) {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
+
+
+st_size_t sm_head_segment_size( st_size_t slot_cnt, st_size_t slot_size )
+{
+    return ( slot_cnt * slot_size ) + sizeof( sm_s );
+}
+
+
+st_size_t sm_head_segment_size_block( st_size_t slot_cnt, st_size_t slot_size )
+{
+    st_size_t header_slots;
+    header_slots = sm_size_in_units( sizeof( sm_s ), slot_size );
+    return ( header_slots + slot_cnt ) * slot_size;
+}
+
+
+st_size_t sm_handle_offset( st_size_t slot_cnt, st_size_t slot_size )
+{
+    return slot_cnt * slot_size;
+}
+
+
+st_size_t sm_slot_size( sm_t sm )
+{
+    return sm->slot_size;
+}
+
+
+st_size_t sm_total_count( sm_t sm )
+{
+    return sm->used_cnt + sm_free_count( sm );
+}
+
+
+st_size_t sm_used_count( sm_t sm )
+{
+    return sm->used_cnt;
+}
+
+
+st_size_t sm_free_count( sm_t sm )
+{
+    if ( sm->ext ) {
+        /* Include decommitted and cleared slots. */
+        return sm->free_cnt + sm->ext->dec_cnt + sm->ext->zero_cnt;
+    }
+
+    return sm->free_cnt;
+}
+
+
+st_size_t sm_spare_count( sm_t sm )
+{
+    if ( sm->ext
+         && __atomic_load_n( &sm->ext->state, __ATOMIC_ACQUIRE ) == SM_PROV_READY ) {
+        return sm->ext->spare->tail_cnt;
+    } else {
+        return 0;
+    }
+}
+
+
+st_size_t sm_host_size( void )
+{
+    return sizeof( sm_s );
+}
+
+
+st_size_t sm_tail_size( void )
+{
+    return sizeof( sm_tail_s );
+}
+
+
+SM_GET_ENTRY st_t sm_get( sm_t sm )
+{
+    return sm_get_at( sm, __builtin_return_address( 0 ) );
+}
+
+
+sm_t sm_put( sm_t sm, st_t slot )
+{
+    sm_t ret;
+
+#ifdef SEGMAN_USE_HOOKS
+    if ( sm->put_cb ) {
+        sm->put_cb( sm, slot );
+    }
+#endif
+
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+        ret = sm_put_slot( sm, slot, sm->ext );
+    } else {
+        ret = sm_put_slot( sm, slot, NULL );
+    }
+
+#ifdef SEGMAN_USE_TRACE
+    if ( ( sm->flags & SM_FLAG_TRACE ) && ret ) {
+        sm_trace_add( sm, SM_TRACE_PUT, slot );
+    }
+#endif
+
+#ifdef SEGMAN_USE_PROFILE
+    if ( ( sm->flags & SM_FLAG_PROFILE ) && ret && sm->ext->prof->sample_cnt ) {
+        sm_prof_put( sm->ext->prof, slot );
+    }
+#endif
+
+    return ret;
+}
+
+
+SM_GET_ENTRY st_t sm_get_wait( sm_t sm, st_size_t timeout_ms, pthread_mutex_t* lock )
+{
+    sm_ext_t        ext;
+    st_t            ret;
+    void*           caller;
+    struct timespec ts;
+
+    caller = __builtin_return_address( 0 );
+
+    ret = sm_get_at( sm, caller );
+
+    if ( ret || timeout_ms == 0 || lock == NULL ) {
+        return ret;
+    }
+
+    ext = sm_ext_get( sm );
+    if ( ext == NULL ) {
+        return NULL;
+    }
+
+    if ( timeout_ms != SM_WAIT_INF ) {
+        clock_gettime( CLOCK_REALTIME, &ts );
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += ( timeout_ms % 1000 ) * 1000000;
+        if ( ts.tv_nsec >= 1000000000 ) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+    }
+
+    ext->waiters++;
+
+    while ( ( ret = sm_get_at( sm, caller ) ) == NULL ) {
+        if ( timeout_ms == SM_WAIT_INF ) {
+            pthread_cond_wait( &ext->wait_cond, lock );
+        } else if ( pthread_cond_timedwait( &ext->wait_cond, lock, &ts ) == ETIMEDOUT ) {
+            ret = sm_get_at( sm, caller );
+            break;
+        }
+    }
+
+    ext->waiters--;
+
+    /*
+     * sm_put() wakes only at empty to non-empty transition, hence
+     * pass the wakeup on, if more slots were released meanwhile.
+     */
+    if ( ret && ext->waiters && sm->free_cnt > 0 ) {
+        pthread_cond_signal( &ext->wait_cond );
+    }
+
+    return ret;
+}
+
+
+int sm_wait_fd( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm_ext_get( sm );
+    if ( ext == NULL ) {
+        return -1;
+    }
+
+    if ( !ext->efd_on ) {
+        ext->efd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if ( ext->efd < 0 ) {
+            return -1;
+        }
+        ext->efd_on = 1;
+    }
+
+    return ext->efd;
+}
+
+
+SM_GET_ENTRY st_t sm_get_zeroed( sm_t sm )
+{
+    sm_ext_t ext;
+    st_t     fresh;
+    st_t     ret;
+    void*    caller;
+
+    ext = sm->ext;
+    caller = __builtin_return_address( 0 );
+
+    if ( ext && ext->zero_head ) {
+
+#ifdef SEGMAN_USE_HOOKS
+        if ( sm->get_cb ) {
+            sm->get_cb( sm, NULL );
+        }
+#endif
+
+        /* Slot was cleared in idle time. */
+        ret = ext->zero_head;
+        ext->zero_head = *( (st_p)ret );
+        ext->zero_cnt--;
+        sm->used_cnt++;
+        *( (st_p)ret ) = NULL;
+
+#ifdef SEGMAN_USE_TRACE
+        if ( sm->flags & SM_FLAG_TRACE ) {
+            sm_trace_add( sm, SM_TRACE_GET, ret );
+        }
+#endif
+
+#ifdef SEGMAN_USE_PROFILE
+        if ( sm->flags & SM_FLAG_PROFILE ) {
+            sm_prof_get( sm, ret, caller );
+        }
+#endif
+
+        return ret;
+    }
+
+    /* Never used slot, if sm_get() takes it. */
+    fresh = ext ? ext->zero_next : NULL;
+
+    ret = sm_get_at( sm, caller );
+
+    if ( ret == NULL ) {
+        return NULL;
+    }
+
+    if ( fresh && ret == fresh ) {
+
+        /* Only the link is set. */
+        *( (st_p)ret ) = NULL;
+
+    } else {
+
+        sm_clear_slot( ret, sm->slot_size );
+    }
+
+    return ret;
+}
+
+
+st_size_t sm_set_zeroed( sm_t sm, st_size_t flags )
+{
+    if ( sm->host.next != NULL || ( sm->flags & SM_FLAG_OBJECT ) ) {
+        return 0;
+    }
+
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    if ( sm->ext->run || sm->ext->running || sm->ext->state != SM_PROV_IDLE ) {
+        /* Segments allocated with the other allocator. */
+        return 0;
+    }
+
+    sm->ext->zero_idle = ( flags & SM_ZERO_IDLE ) != 0;
+    sm->flags |= SM_FLAG_ZERO;
+
+    return 1;
+}
+
+
+st_t sm_get_run( sm_t sm, st_size_t n )
+{
+    sm_run_t run;
+    st_id_t  idx;
+
+    if ( n == 0 || n > SM_RUN_MAX || ( sm->flags & SM_FLAG_OBJECT ) ) {
+        return NULL;
+    }
+
+    if ( sm_ext_get( sm ) == NULL ) {
+        return NULL;
+    }
+
+    for ( run = sm->ext->run; run; run = run->next ) {
+        if ( run->seg->tail_cnt - run->used_cnt >= n ) {
+            idx = sm_run_find( run, n );
+            if ( idx >= 0 ) {
+                break;
+            }
+        }
+    }
+
+    if ( run == NULL ) {
+
+        if ( sm->resize == 0 || ( sm->flags & SM_FLAG_FIXED ) || n > sm_tail_slots( sm ) ) {
+            /* Run does not fit to a Segment. */
+            return NULL;
+        }
+
+        run = sm_run_new( sm );
+        if ( run == NULL ) {
+            return NULL;
+        }
+
+        idx = sm_run_find( run, n );
+    }
+
+    sm_run_mark( run, idx, n, 1 );
+    run->used_cnt += n;
+
+    return run->seg->base + idx * sm->slot_size;
+}
+
+
+sm_t sm_put_run( sm_t sm, st_t slot, st_size_t n )
+{
+    sm_run_t  run;
+    st_size_t idx;
+
+    if ( sm->ext == NULL ) {
+        return NULL;
+    }
+
+    for ( run = sm->ext->run; run; run = run->next ) {
+        if ( slot >= run->seg->base
+             && slot < run->seg->base + run->seg->tail_cnt * sm->slot_size ) {
+            idx = ( slot - run->seg->base ) / sm->slot_size;
+            if ( ( slot - run->seg->base ) % sm->slot_size != 0 || n == 0
+                 || idx + n > run->seg->tail_cnt || !sm_run_used( run, idx, n ) ) {
+                /* Misaligned, or slots not allocated. */
+                return NULL;
+            }
+            sm_run_mark( run, idx, n, 0 );
+            run->used_cnt -= n;
+            return sm;
+        }
+    }
+
+    return NULL;
+}
+
+
+st_size_t sm_set_deferred( sm_t sm )
+{
+    sm_ebr_t ebr;
+
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    if ( sm->ext->ebr ) {
+        return 1;
+    }
+
+    ebr = st_alloc( sizeof( sm_ebr_s ) );
+    if ( ebr == NULL ) {
+        return 0;
+    }
+
+    memset( ebr, 0, sizeof( sm_ebr_s ) );
+    sm->ext->ebr = ebr;
+
+    return 1;
+}
+
+
+sm_t sm_put_deferred( sm_t sm, st_t slot )
+{
+    sm_ebr_t  ebr;
+    sm_bag_t  bag;
+    st_size_t e;
+
+    if ( sm->ext == NULL || sm->ext->ebr == NULL ) {
+        /* Not in deferred mode. */
+        return NULL;
+    }
+
+    ebr = sm->ext->ebr;
+    e = ebr->epoch % 3;
+    bag = ebr->bag[ e ];
+
+    if ( bag == NULL || bag->cnt == SM_BAG_SLOT_CNT ) {
+
+        if ( ebr->spare ) {
+            bag = ebr->spare;
+            ebr->spare = bag->next;
+        } else {
+            bag = st_alloc( sizeof( sm_bag_s ) );
+            if ( bag == NULL ) {
+                return NULL;
+            }
+        }
+
+        bag->cnt = 0;
+        bag->next = ebr->bag[ e ];
+        ebr->bag[ e ] = bag;
+    }
+
+    /* Add to the bags of current epoch. */
+    bag->slot[ bag->cnt++ ] = slot;
+    ebr->cnt[ e ]++;
+
+    if ( ++ebr->pending >= SM_DEFER_BATCH_CNT ) {
+        sm_ebr_reclaim( sm );
+    }
+
+    return sm;
+}
+
+
+st_size_t sm_reclaim( sm_t sm )
+{
+    if ( sm->ext == NULL || sm->ext->ebr == NULL ) {
+        return 0;
+    }
+
+    return sm_ebr_reclaim( sm );
+}
+
+
+st_size_t sm_read_enter( sm_t sm )
+{
+    sm_ebr_t  ebr;
+    st_size_t idx;
+    st_size_t i;
+    st_size_t idle;
+    st_size_t state;
+
+    assert( sm->ext && sm->ext->ebr );
+
+    ebr = sm->ext->ebr;
+
+    /* Spread threads over the records. */
+    idx = ( (uintptr_t)&idx >> 12 ) % SM_READER_MAX;
+
+    for ( ;; ) {
+        for ( i = 0; i < SM_READER_MAX; i++ ) {
+            state = ( __atomic_load_n( &ebr->epoch, __ATOMIC_ACQUIRE ) << 1 ) | 1;
+            idle = 0;
+            if ( __atomic_compare_exchange_n( &ebr->reader[ idx ].state,
+                                              &idle,
+                                              state,
+                                              0,
+                                              __ATOMIC_SEQ_CST,
+                                              __ATOMIC_RELAXED ) ) {
+                return idx;
+            }
+            idx = ( idx + 1 ) % SM_READER_MAX;
+        }
+        sched_yield();
+    }
+}
+
+
+st_none sm_read_exit( sm_t sm, st_size_t token )
+{
+    assert( sm->ext && sm->ext->ebr );
+    __atomic_store_n( &sm->ext->ebr->reader[ token ].state, 0, __ATOMIC_RELEASE );
+}
+
+
+st_size_t sm_set_object( sm_t sm, sm_obj_fn ctor, sm_obj_fn dtor, st_size_t link_off )
+{
+    if ( sm->host.init_cnt != 0 || sm->host.next != NULL || ( sm->ext && sm->ext->run )
+         || ( sm->flags & SM_FLAG_ZERO ) ) {
+        /* Slots have been set up already. */
+        return 0;
+    }
+
+    if ( link_off + sizeof( st_t ) > sm->slot_size || ( link_off % sizeof( st_t ) ) != 0 ) {
+        return 0;
+    }
+
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    sm->ext->ctor = ctor;
+    sm->ext->dtor = dtor;
+    sm->ext->link_off = link_off;
+
+    sm->flags |= SM_FLAG_OBJECT;
+
+    return 1;
+}
+
+
+st_size_t sm_trace_start( sm_t sm, st_size_t ev_cnt, int fd )
+{
+#ifdef SEGMAN_USE_TRACE
+
+    sm_trace_t trc;
+
+    if ( ev_cnt == 0 || fd < 0 || sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    if ( sm->ext->trace ) {
+        sm_trace_stop( sm );
+    }
+
+    trc = st_alloc( sizeof( sm_trace_s ) + ev_cnt * sizeof( sm_trace_ev_s ) );
+    if ( trc == NULL ) {
+        return 0;
+    }
+
+    trc->fd = fd;
+    trc->size = ev_cnt;
+    trc->cnt = 0;
+    trc->start = sm_trace_time();
+    trc->seg = NULL;
+    trc->seg_cnt = 0;
+    trc->seg_size = 0;
+    trc->seg_next = 0;
+
+    sm->ext->trace = trc;
+    sm->flags |= SM_FLAG_TRACE;
+
+    return 1;
+
+#else
+
+    (void)sm;
+    (void)ev_cnt;
+    (void)fd;
+
+    return 0;
+
+#endif
+}
+
+
+st_size_t sm_trace_flush( sm_t sm )
+{
+    if ( sm->ext == NULL || sm->ext->trace == NULL ) {
+        return 0;
+    }
+
+    return sm_trace_write( sm );
+}
+
+
+st_size_t sm_trace_stop( sm_t sm )
+{
+    st_size_t ret;
+
+    if ( sm->ext == NULL || sm->ext->trace == NULL ) {
+        return 0;
+    }
+
+    ret = sm_trace_write( sm );
+
+    sm_trace_del( sm->ext->trace );
+    sm->ext->trace = NULL;
+    sm->flags &= ~SM_FLAG_TRACE;
+
+    return ret;
+}
+
+
+st_size_t sm_profile_start( sm_t sm, st_size_t interval, st_size_t flags )
+{
+#ifdef SEGMAN_USE_PROFILE
+
+    sm_prof_t prof;
+
+    if ( interval == 0 || sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    if ( sm->ext->prof ) {
+        sm_profile_stop( sm );
+    }
+
+    prof = st_alloc( sizeof( sm_prof_s ) );
+    if ( prof == NULL ) {
+        return 0;
+    }
+
+    memset( prof, 0, sizeof( sm_prof_s ) );
+
+    prof->interval = interval;
+    prof->step = ( flags & SM_PROFILE_BYTES ) ? sm->slot_size : 1;
+    prof->seed = (uintptr_t)prof | 1;
+    sm_prof_next( prof );
+
+    sm->ext->prof = prof;
+    sm->flags |= SM_FLAG_PROFILE;
+
+    return 1;
+
+#else
+
+    (void)sm;
+    (void)interval;
+    (void)flags;
+
+    return 0;
+
+#endif
+}
+
+
+st_size_t sm_profile_stop( sm_t sm )
+{
+    if ( sm->ext == NULL || sm->ext->prof == NULL ) {
+        return 0;
+    }
+
+    if ( sm->ext->prof->sample ) {
+        st_del( sm->ext->prof->sample );
+    }
+
+    st_del( sm->ext->prof );
+    sm->ext->prof = NULL;
+    sm->flags &= ~SM_FLAG_PROFILE;
+
+    return 1;
+}
+
+
+st_size_t sm_profile_dump( sm_t sm, int fd )
+{
+#ifdef SEGMAN_USE_PROFILE
+
+    sm_prof_t  prof;
+    sm_site_t* site;
+    st_size_t  cnt;
+    st_size_t  unit;
+    st_size_t  i;
+    st_size_t  d;
+    char**     sym;
+
+    if ( sm->ext == NULL || sm->ext->prof == NULL ) {
+        return 0;
+    }
+
+    prof = sm->ext->prof;
+
+    site = st_alloc( ( SM_PROFILE_SITE_CNT + 1 ) * sizeof( sm_site_t ) );
+    if ( site == NULL ) {
+        return 0;
+    }
+
+    cnt = 0;
+    for ( i = 0; i < SM_PROFILE_SITE_CNT; i++ ) {
+        if ( prof->site[ i ].live ) {
+            site[ cnt++ ] = &prof->site[ i ];
+        }
+    }
+    if ( prof->other.live ) {
+        site[ cnt++ ] = &prof->other;
+    }
+
+    qsort( site, cnt, sizeof( sm_site_t ), sm_site_cmp );
+
+    /* Bytes represented by one sample. */
+    unit = prof->interval * ( prof->step == 1 ? sm->slot_size : 1 );
+
+    dprintf( fd,
+             "# slot_size %lu, interval %lu %s, live samples %lu\n",
+             sm->slot_size,
+             prof->interval,
+             prof->step == 1 ? "gets" : "bytes",
+             prof->sample_cnt );
+
+    for ( i = 0; i < cnt; i++ ) {
+
+        dprintf( fd,
+                 "live_slots %lu live_bytes %lu samples %lu/%lu\n",
+                 site[ i ]->live * unit / sm->slot_size,
+                 site[ i ]->live * unit,
+                 site[ i ]->live,
+                 site[ i ]->total );
+
+        sym = NULL;
+        if ( site[ i ]->depth ) {
+            sym = backtrace_symbols( site[ i ]->pc, site[ i ]->depth );
+        }
+
+        for ( d = 0; d < site[ i ]->depth; d++ ) {
+            if ( sym ) {
+                dprintf( fd, "    %s\n", sym[ d ] );
+            } else {
+                dprintf( fd, "    %p\n", site[ i ]->pc[ d ] );
+            }
+        }
+
+        if ( site[ i ] == &prof->other ) {
+            dprintf( fd, "    (other)\n" );
+        }
+
+        free( sym );
+    }
+
+    st_del( site );
+
+    return 1;
+
+#else
+
+    (void)sm;
+    (void)fd;
+
+    return 0;
+
+#endif
+}
+
+
+#ifdef SEGMAN_USE_HOOKS
+
+void sm_set_get_cb( sm_t sm, sm_hook_fn cb )
+{
+    sm->get_cb = cb;
+}
+
+void sm_set_put_cb( sm_t sm, sm_hook_fn cb )
+{
+    sm->put_cb = cb;
+}
+
+#endif
+
+
+
+/* ------------------------------------------------------------
+ * Registry:
+ */
+
+st_none sm_registry_enable( st_size_t enable )
+{
+    __atomic_store_n( &sm_reg_on, enable, __ATOMIC_RELAXED );
+}
+
+
+st_size_t sm_set_name( sm_t sm, const char* name )
+{
+    if ( sm_ext_get( sm ) == NULL ) {
+        return 0;
+    }
+
+    pthread_mutex_lock( &sm_reg_lock );
+    strncpy( sm->ext->name, name, SM_NAME_MAX - 1 );
+    sm->ext->name[ SM_NAME_MAX - 1 ] = 0;
+    pthread_mutex_unlock( &sm_reg_lock );
+
+    if ( __atomic_load_n( &sm_reg_on, __ATOMIC_RELAXED ) ) {
+        sm_reg_add( sm );
+    }
+
+    return 1;
+}
+
+
+st_size_t sm_registry_dump( int fd, st_size_t format )
+{
+    sm_ext_t  cur;
+    st_size_t first;
+
+    if ( format != SM_DUMP_TEXT && format != SM_DUMP_JSON ) {
+        return 0;
+    }
+
+    pthread_mutex_lock( &sm_reg_lock );
+
+    if ( format == SM_DUMP_JSON ) {
+        dprintf( fd, "{\"pools\":[" );
+    }
+
+    first = 1;
+    for ( cur = sm_reg_head; cur; cur = cur->reg_next ) {
+        sm_reg_write( fd, format, cur->sm, first );
+        first = 0;
+    }
+
+    if ( format == SM_DUMP_JSON ) {
+        dprintf( fd, "]}\n" );
+    }
+
+    pthread_mutex_unlock( &sm_reg_lock );
+
+    return 1;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Memory budget:
+ */
+
+sm_budget_t sm_budget_new( st_size_t limit, st_size_t wait_ms )
+{
+    sm_budget_t bg;
+
+    bg = st_alloc( sizeof( sm_budget_s ) );
+    if ( bg == NULL ) {
+        return NULL;
+    }
+
+    bg->limit = limit;
+    bg->used = 0;
+    bg->wait_ms = wait_ms;
+    bg->pool_cnt = 0;
+    pthread_mutex_init( &bg->lock, NULL );
+    pthread_cond_init( &bg->cond, NULL );
+
+    return bg;
+}
+
+
+sm_budget_t sm_budget_del( sm_budget_t bg )
+{
+    pthread_cond_destroy( &bg->cond );
+    pthread_mutex_destroy( &bg->lock );
+    st_del( bg );
+    return NULL;
+}
+
+
+st_size_t sm_budget_used( sm_budget_t bg )
+{
+    return __atomic_load_n( &bg->used, __ATOMIC_RELAXED );
+}
+
+
+st_size_t sm_set_budget( sm_t sm, sm_budget_t bg )
+{
+    sm_ext_t  ext;
+    sm_tail_t cur;
+    sm_run_t  run;
+    st_t      mem;
+    st_size_t size;
+    st_size_t bytes;
+
+    ext = sm_ext_get( sm );
+    if ( ext == NULL ) {
+        return 0;
+    }
+
+    sm_budget_leave( sm );
+
+    if ( bg == NULL ) {
+        return 1;
+    }
+
+    /* Existing memory is charged, even if it exceeds the limit. */
+    sm_info_s info;
+    info = sm_host_info( sm->slot_cnt, sm->block_size, sm->slot_size );
+    bytes = info.header_size + info.slot_area;
+
+    for ( cur = sm->host.next; cur; cur = cur->next ) {
+        sm_seg_span( sm, cur, &mem, &size );
+        bytes += size;
+    }
+
+    for ( run = ext->run; run; run = run->next ) {
+        sm_seg_span( sm, run->seg, &mem, &size );
+        bytes += size;
+    }
+
+    if ( __atomic_load_n( &ext->state, __ATOMIC_ACQUIRE ) == SM_PROV_READY ) {
+        sm_seg_span( sm, ext->spare, &mem, &size );
+        bytes += size;
+    }
+
+    __atomic_add_fetch( &bg->used, bytes, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &bg->pool_cnt, 1, __ATOMIC_RELAXED );
+    ext->budget_used = bytes;
+    ext->budget = bg;
+
+    return 1;
+}
+
+
+st_size_t sm_trim( sm_t sm )
+{
+    sm_tail_t cur;
+    sm_tail_t next;
+    st_t      mem;
+    st_size_t size;
+    st_size_t ret;
+
+    if ( sm->flags & SM_FLAG_FIXED ) {
+        /* Reserved Segments are needed. */
+        return 0;
+    }
+
+    if ( sm->flags & SM_FLAG_TRACE ) {
+        /* Events refer to the released Segments. */
+        sm_trace_flush( sm );
+    }
+
+    ret = 0;
+
+    /* Segments after tail are unused (reserved or left from sm_reset). */
+    cur = sm->tail->next;
+    sm->tail->next = NULL;
+
+    while ( cur ) {
+        next = cur->next;
+        sm_seg_span( sm, cur, &mem, &size );
+        ret += size;
+        sm_free_seg( sm, cur );
+        cur = next;
+    }
+
+    /* Provisioned Segment is taken (as in sm_use_spare()). */
+    if ( sm->ext && __atomic_load_n( &sm->ext->state, __ATOMIC_ACQUIRE ) == SM_PROV_READY ) {
+        sm_seg_span( sm, sm->ext->spare, &mem, &size );
+        ret += size;
+        sm_free_seg( sm, sm->ext->spare );
+        sm->ext->spare = NULL;
+        __atomic_store_n( &sm->ext->state, SM_PROV_IDLE, __ATOMIC_RELEASE );
+    }
+
+    /* Segments in use, which have only free slots. */
+    ret += sm_trim_empty( sm );
+
+    return ret;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Per-CPU front end:
+ */
+
+sm_cpu_t sm_cpu_new( sm_t sm, st_size_t cache_cnt )
+{
+    sm_cpu_t smc;
+    long     cpu_cnt;
+
+    smc = st_alloc( sizeof( sm_cpu_s ) );
+    if ( smc == NULL ) {
+        return NULL;
+    }
+
+    cpu_cnt = sysconf( _SC_NPROCESSORS_CONF );
+    if ( cpu_cnt < 1 ) {
+        cpu_cnt = 1;
+    }
+
+    if ( cache_cnt == 0 ) {
+        cache_cnt = SM_CPU_CACHE_CNT;
+    }
+
+    smc->sm = sm;
+    smc->shard_cnt = cpu_cnt;
+    smc->cache_cnt = cache_cnt;
+
+    /* Caches in separate cache lines. */
+    smc->stride = sizeof( sm_shard_s ) + cache_cnt * sizeof( st_t );
+    smc->stride = ( smc->stride + 63 ) & ~63UL;
+
+    smc->mem = st_alloc( smc->shard_cnt * smc->stride + 64 );
+    if ( smc->mem == NULL ) {
+        st_del( smc );
+        return NULL;
+    }
+    memset( smc->mem, 0, smc->shard_cnt * smc->stride + 64 );
+    smc->shards = (st_t)( ( (uintptr_t)smc->mem + 63 ) & ~63UL );
+
+#ifdef SM_USE_RSEQ
+    /* Registered by libc, unless disabled. */
+    smc->rseq = ( __rseq_size > 0 );
+#else
+    smc->rseq = 0;
+#endif
+
+    pthread_mutex_init( &smc->lock, NULL );
+
+    return smc;
+}
+
+
+sm_cpu_t sm_cpu_del( sm_cpu_t smc )
+{
+    sm_shard_t shard;
+    st_size_t  i;
+
+    for ( i = 0; i < smc->shard_cnt; i++ ) {
+        shard = sm_shard( smc, i );
+        while ( shard->cur > 0 ) {
+            shard->cur--;
+            sm_put( smc->sm, shard->slot[ shard->cur ] );
+        }
+    }
+
+    pthread_mutex_destroy( &smc->lock );
+    st_del( smc->mem );
+    st_del( smc );
+
+    return NULL;
+}
+
+
+st_t sm_cpu_get( sm_cpu_t smc )
+{
+    st_t slot;
+
+    if ( sm_shard_pop( smc, &slot ) ) {
+        return slot;
+    } else {
+        return sm_cpu_refill( smc );
+    }
+}
+
+
+sm_cpu_t sm_cpu_put( sm_cpu_t smc, st_t slot )
+{
+    if ( !sm_shard_push( smc, slot ) ) {
+        sm_cpu_drain( smc, slot );
+    }
+
+    return smc;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ * ------------------------------------------------------------ */
+
+/**
+ * Return size of block in terms of the unit.
+ *
+ * @param block_size Block size;
+ * @param unit_size  Unit size.
+ *
+ * @return Block size in units.
+ */
+static st_size_t sm_size_in_units( st_size_t block_size, st_size_t unit_size )
+{
+    st_size_t odd;
+    st_size_t slots;
+
+    slots = ( block_size / unit_size );
+    odd = ( ( block_size % unit_size ) != 0 );
+
+    return slots + odd;
+}
+
+
+/**
+ * Return host segment info.
+ *
+ * @param slot_cnt   Slot count.
+ * @param block_size Block size;
+ * @param slot_size  Slot size.
+ *
+ * @return Segment info.
+ */
+static sm_info_s sm_host_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size )
+{
+    sm_info_s info;
+
+    if ( block_size == 0 ) {
+
+        info.header_size = sizeof( sm_s );
+        info.slot_area = ( slot_cnt * slot_size );
+
+    } else {
+
+        st_size_t header_slots;
+        st_size_t slot_cnt;
+
+        header_slots = sm_size_in_units( sizeof( sm_s ), slot_size );
+        info.header_size = ( header_slots * slot_size );
+        slot_cnt = ( block_size - info.header_size ) / slot_size;
+        info.slot_area = slot_cnt * slot_size;
+    }
+
+    info.color_cnt = 1;
+
+    return info;
+}
+
+
+/**
+ * Return tail segment info. Slot area may be placed at "color_cnt"
+ * different cache line offsets, starting from "header_size". In Block
+ * mode the space for colors is taken from the header slots and from
+ * the space left over from the slots. Otherwise at most a slot worth
+ * of extra space is used.
+ *
+ * @param slot_cnt   Slot count.
+ * @param block_size Block size;
+ * @param slot_size  Slot size.
+ *
+ * @return Segment info.
+ */
+static sm_info_s sm_tail_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size )
+{
+    sm_info_s info;
+
+    if ( block_size == 0 ) {
+
+        info.header_size = sizeof( sm_tail_s );
+        info.slot_area = ( slot_cnt * slot_size );
+        info.color_cnt = ( slot_size / SM_CACHE_LINE ) + ( slot_size < SM_CACHE_LINE );
+
+    } else {
+
+        st_size_t header_slots;
+        st_size_t slot_cnt;
+        st_size_t first;
+        st_size_t last;
+
+        header_slots = sm_size_in_units( sizeof( sm_tail_s ), slot_size );
+        info.header_size = ( header_slots * slot_size );
+        slot_cnt = ( block_size - info.header_size ) / slot_size;
+        info.slot_area = slot_cnt * slot_size;
+
+        /* Slot area may start at any cache line after the header. */
+        first = sm_size_in_units( sizeof( sm_tail_s ), SM_CACHE_LINE ) * SM_CACHE_LINE;
+        last = block_size - info.slot_area;
+
+        if ( first <= last ) {
+            info.header_size = first;
+            info.color_cnt = ( last - first ) / SM_CACHE_LINE + 1;
+        } else {
+            info.color_cnt = 1;
+        }
+    }
+
+    return info;
+}
+
+
+/**
+ * Prepare the next slot that requires a link.
+ *
+ * @param sm  Segman.
+ * @param obj Object mode extension (or NULL).
+ *
+ * @return NA
+ */
+static st_none sm_prepare_slot( sm_t sm, sm_ext_t obj )
+{
+    /* Make sure that each slot has a link before it is allocated. */
+    st_t slot;
+    slot = sm->tail->base + ( sm->tail->init_cnt * sm->slot_size );
+
+    if ( obj ) {
+
+        /* Construct before link, since link is within the object. */
+        if ( obj->ctor ) {
+            obj->ctor( sm, slot );
+        }
+
+        *( (st_p)( slot + obj->link_off ) ) = slot + sm->slot_size;
+
+    } else {
+
+        /* Make Slot N content to point to Slot N+1. */
+        *( (st_p)slot ) = slot + sm->slot_size;
+    }
+
+    sm->tail->init_cnt++;
+}
+
+
+/**
+ * Get slot with hooks, trace and profiling. Get is sampled to the
+ * call stack from "caller" on.
+ *
+ * @param sm     Segman.
+ * @param caller Return address of user get call.
+ *
+ * @return Slot (or NULL if out-of-slots).
+ */
+static inline st_t sm_get_at( sm_t sm, void* caller )
+{
+    st_t ret;
+
+#ifdef SEGMAN_USE_HOOKS
+    if ( sm->get_cb ) {
+        sm->get_cb( sm, NULL );
+    }
+#endif
+
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+        ret = sm_get_slot( sm, sm->ext );
+    } else {
+        ret = sm_get_slot( sm, NULL );
+    }
+
+#ifdef SEGMAN_USE_TRACE
+    if ( ( sm->flags & SM_FLAG_TRACE ) && ret ) {
+        sm_trace_add( sm, SM_TRACE_GET, ret );
+    }
+#endif
+
+#ifdef SEGMAN_USE_PROFILE
+    if ( ( sm->flags & SM_FLAG_PROFILE ) && ret ) {
+        sm_prof_get( sm, ret, caller );
+    }
+#else
+    (void)caller;
+#endif
+
+    return ret;
+}
+
+
+/**
+ * Get slot. In object mode, links are at "obj->link_off".
+ *
+ * @param sm  Segman.
+ * @param obj Object mode extension (or NULL).
+ *
+ * @return Memory slot (or NULL if memory pool is exhausted).
+ */
+static inline st_t sm_get_slot( sm_t sm, sm_ext_t obj )
+{
+    st_size_t off;
+
+    off = obj ? obj->link_off : 0;
+
+retry:
+
+    if ( sm->tail->init_cnt < sm->tail->tail_cnt ) {
+        sm_prepare_slot( sm, obj );
+    }
+
+    st_t ret = NULL;
+
+    if ( sm->free_cnt > 0 ) {
+
+        ret = sm->head;
+
+        sm->used_cnt++;
+        sm->free_cnt--;
+
+        if ( ( sm->flags & SM_FLAG_ZERO ) && ret == sm->ext->zero_next ) {
+            /* Slot is not fresh after any get. */
+            sm->ext->zero_next += sm->slot_size;
+            if ( sm->ext->zero_next == sm->ext->zero_end ) {
+                sm->ext->zero_next = NULL;
+            }
+        }
+
+        if ( sm->free_cnt > 0 ) {
+
+            /* Get the link info from returned slot. */
+            sm->head = *( (st_p)( sm->head + off ) );
+
+        } else {
+
+            /* No more slots, out-of-mem. */
+            sm->head = NULL;
+        }
+
+    } else if ( sm->tail->next ) {
+
+        /* Pre-existing Tail Segment (left from sm_reset). */
+        sm->tail = sm->tail->next;
+        sm_reset_seg( sm, sm->tail );
+        sm->head = sm->tail->base;
+        sm->free_cnt += sm->tail->tail_cnt;
+        goto retry;
+
+    } else if ( sm->ext && sm->ext->ebr && sm_ebr_reclaim( sm ) ) {
+
+        /* Reclaimed deferred slots. */
+        goto retry;
+
+    } else if ( sm->ext && sm->ext->dec && sm_recommit( sm ) ) {
+
+        /* Decommitted slots. */
+        goto retry;
+
+    } else if ( sm->ext && sm->ext->zero_head && sm_zero_splice( sm ) ) {
+
+        /* Cleared slots. */
+        goto retry;
+
+    } else if ( sm->ext && sm_use_spare( sm ) ) {
+
+        /* Provisioned Segment. */
+        goto retry;
+
+    } else if ( sm->resize != 0 && !( sm->flags & SM_FLAG_FIXED ) && sm_new_seg( sm ) ) {
+
+        goto retry;
+    }
+
+    if ( sm->flags & SM_FLAG_LOWAT ) {
+        sm_low_water( sm );
+    }
+
+    return ret;
+}
+
+
+/**
+ * Put slot back to pool.
+ *
+ * @param sm   Segman.
+ * @param slot Slot to return to pool.
+ * @param obj  Object mode extension (or NULL).
+ *
+ * @return Pool on success (NULL otherwise).
+ */
+static inline sm_t sm_put_slot( sm_t sm, st_t slot, sm_ext_t obj )
+{
+    st_size_t off;
+
+    off = obj ? obj->link_off : 0;
+
+    if ( sm->used_cnt == 0 ) {
+        return NULL;
+    }
+
+    if ( sm->head != NULL ) {
+
+        /* Store index of previous free slot to freed slot. */
+        *( (st_p)( slot + off ) ) = sm->head;
+
+        /* Update free slot to freed slot. */
+        sm->head = slot;
+
+    } else {
+
+        /*
          * First free after out-of-mem. Store a "dummy" index
          * (out-of-bounds).
          */
-        *( (st_p)slot ) = NULL;
+        *( (st_p)( slot + off ) ) = NULL;
         sm->head = slot;
+
+        /* Pool is not empty anymore. */
+        if ( sm->ext && ( sm->ext->waiters | sm->ext->efd_on ) ) {
+            sm_wake( sm );
+        }
+    }
+
+    sm->used_cnt--;
+    sm->free_cnt++;
+
+    return sm;
+}
+
+
+/**
+ * Reset Segment for lazy initialization. In object mode, the
+ * constructed slots are kept and only their links are restored.
+ *
+ * Host is reset in sm_reset(), and Tail Segments when they are taken
+ * into use again.
+ *
+ * @param sm  Segman.
+ * @param seg Segment.
+ *
+ * @return NA
+ */
+static st_none sm_reset_seg( sm_t sm, sm_tail_t seg )
+{
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+
+        st_t      slot;
+        st_size_t off;
+        st_size_t i;
+
+        off = sm->ext->link_off;
+        slot = seg->base;
+
+        for ( i = 0; i < seg->init_cnt; i++ ) {
+            *( (st_p)( slot + off ) ) = slot + sm->slot_size;
+            slot += sm->slot_size;
+        }
+
+    } else {
+
+        seg->init_cnt = 0;
+    }
+}
+
+
+/**
+ * Run destructor for constructed slots of Segment.
+ *
+ * @param sm  Segman.
+ * @param seg Segment.
+ *
+ * @return NA
+ */
+static st_none sm_dtor_seg( sm_t sm, sm_tail_t seg )
+{
+    st_t      slot;
+    st_size_t i;
+
+    if ( sm->ext->dtor == NULL ) {
+        return;
+    }
+
+    slot = seg->base;
+
+    for ( i = 0; i < seg->init_cnt; i++ ) {
+        sm->ext->dtor( sm, slot );
+        slot += sm->slot_size;
+    }
+}
+
+
+/**
+ * Return the number of slots in a new Tail Segment.
+ *
+ * @param sm Segman.
+ *
+ * @return Slot count.
+ */
+static st_size_t sm_tail_slots( sm_t sm )
+{
+    st_size_t resize;
+
+    if ( sm->block_size == 0 ) {
+        /* Reservation is possible with resize factor 0. */
+        resize = ( sm->resize != 0 ) ? sm->resize : 100;
+        return ( resize * sm->slot_cnt ) / 100;
+    } else {
+        sm_info_s info;
+        info = sm_tail_info( sm->slot_cnt, sm->block_size, sm->slot_size );
+        return info.slot_area / sm->slot_size;
+    }
+}
+
+
+/**
+ * Return color after the last Segment of chain (unlimited by color
+ * count). Color of a Segment is the offset of its slot area.
+ *
+ * @param sm Segman.
+ *
+ * @return Color.
+ */
+static st_size_t sm_color_next( sm_t sm )
+{
+    sm_tail_t cur;
+
+    sm_info_s info;
+    info = sm_tail_info( sm->slot_cnt, sm->block_size, sm->slot_size );
+
+    for ( cur = sm->tail; cur->next; cur = cur->next ) {
+    }
+
+    if ( cur == &sm->host ) {
+        return 0;
+    }
+
+    return ( cur->base - (st_t)cur - info.header_size ) / SM_CACHE_LINE + 1;
+}
+
+
+/**
+ * Allocate new Segman Segment, but leave it unlinked. Slot area
+ * offset is rotated over the available colors, so that the slots of
+ * different Segments map to different cache sets. Colors are rotated
+ * per Segman: from the counter in extension state, since Segments are
+ * also allocated outside of chain (runs, provisioning), or otherwise
+ * from the color of the last Segment in chain.
+ * Segment is charged to the budget, if Segman has one.
+ *
+ * @param sm       Segman.
+ * @param slot_cnt Number of slots (ignored in Block mode).
+ *
+ * @return Segment (or NULL if allocation failed).
+ */
+static sm_tail_t sm_alloc_seg( sm_t sm, st_size_t slot_cnt )
+{
+    st_size_t color;
+    st_size_t size;
+    sm_tail_t new_seg;
+
+    sm_info_s info;
+    info = sm_tail_info( sm->slot_cnt, sm->block_size, sm->slot_size );
+
+    if ( sm->ext ) {
+        /* Provisioning thread might allocate too. */
+        color = __atomic_fetch_add( &sm->ext->color, 1, __ATOMIC_RELAXED );
+    } else {
+        color = sm_color_next( sm );
+    }
+    color = ( color % info.color_cnt ) * SM_CACHE_LINE;
+
+    if ( sm->block_size == 0 ) {
+        size = info.header_size + color + ( slot_cnt * sm->slot_size );
+    } else {
+        slot_cnt = info.slot_area / sm->slot_size;
+        size = sm->block_size;
+    }
+
+    if ( sm->ext && sm->ext->budget && !sm_budget_charge( sm, size ) ) {
+        return NULL;
+    }
+
+    new_seg = st_alloc( size );
+
+    if ( new_seg == NULL ) {
+        if ( sm->ext && sm->ext->budget ) {
+            sm_budget_release( sm, size );
+        }
+        return NULL;
+    }
+
+    if ( sm->flags & SM_FLAG_ZERO ) {
+        /* Cleared once here, fresh slots are not cleared at get. */
+        memset( new_seg, 0, size );
+    }
+
+    new_seg->base = (st_t)new_seg + info.header_size + color;
+    new_seg->tail_cnt = slot_cnt;
+    new_seg->init_cnt = 0;
+    new_seg->next = NULL;
+
+    if ( sm->ext ) {
+        sm_reg_count( sm, new_seg, size, 1 );
+    }
+
+    return new_seg;
+}
+
+
+/**
+ * Allocate new Segman Segment and take it into use.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+static st_size_t sm_new_seg( sm_t sm )
+{
+    sm_tail_t seg;
+
+    seg = sm_alloc_seg( sm, sm_tail_slots( sm ) );
+    if ( seg == NULL ) {
+        return 0;
+    }
+
+    sm_link_seg( sm, seg );
+
+    return 1;
+}
+
+
+/**
+ * Link Segment after the current Segment and take it into use.
+ *
+ * @param sm  Segman.
+ * @param seg Segment.
+ *
+ * @return NA
+ */
+static st_none sm_link_seg( sm_t sm, sm_tail_t seg )
+{
+    sm->tail->next = seg;
+
+    sm->head = seg->base;
+    sm->tail = seg;
+    sm->free_cnt += seg->tail_cnt;
+
+    if ( sm->flags & SM_FLAG_ZERO ) {
+        sm->ext->zero_next = seg->base;
+        sm->ext->zero_end = seg->base + seg->tail_cnt * sm->slot_size;
+    }
+
+#ifdef SEGMAN_USE_TRACE
+    if ( sm->flags & SM_FLAG_TRACE ) {
+        sm_trace_add( sm, SM_TRACE_GROW, seg->base );
+    }
+#endif
+}
+
+
+/**
+ * Free Tail Segment memory.
+ *
+ * @param sm  Segman.
+ * @param seg Segment.
+ *
+ * @return NA
+ */
+static st_none sm_free_seg( sm_t sm, sm_tail_t seg )
+{
+    st_t      mem;
+    st_size_t size;
+
+    if ( sm->flags & SM_FLAG_OBJECT ) {
+        sm_dtor_seg( sm, seg );
+    }
+
+    sm_seg_span( sm, seg, &mem, &size );
+
+    if ( sm->flags & SM_FLAG_LOCKED ) {
+        munlock( mem, size );
+    }
+
+    if ( sm->flags & SM_FLAG_TRACE ) {
+        /* Address might be reused by a new Segment. */
+        sm_trace_seg_rem( sm->ext->trace, seg );
+    }
+
+    if ( sm->ext ) {
+        sm_reg_count( sm, seg, size, 0 );
+        if ( sm->ext->budget ) {
+            sm_budget_release( sm, size );
+        }
+    }
+
+    st_del( seg );
+}
+
+
+/**
+ * Return the memory span of Segment. For Host only the slot area is
+ * included.
+ *
+ * @param sm   Segman.
+ * @param seg  Segment.
+ * @param mem  Span start (output).
+ * @param size Span size in bytes (output).
+ *
+ * @return NA
+ */
+static st_none sm_seg_span( sm_t sm, sm_tail_t seg, st_t* mem, st_size_t* size )
+{
+    if ( seg == &sm->host ) {
+        *mem = seg->base;
+        *size = seg->tail_cnt * sm->slot_size;
+    } else if ( sm->block_size == 0 ) {
+        *mem = seg;
+        *size = ( seg->base - (st_t)seg ) + ( seg->tail_cnt * sm->slot_size );
+    } else {
+        *mem = seg;
+        *size = sm->block_size;
+    }
+}
+
+
+/**
+ * Prefault and/or lock Segment memory.
+ *
+ * Pages are touched by writing back the existing content, since free
+ * slots might already contain links.
+ *
+ * @param sm    Segman.
+ * @param seg   Segment.
+ * @param flags Reservation flags.
+ *
+ * @return 1 on success (0 on failure).
+ */
+static st_size_t sm_commit_seg( sm_t sm, sm_tail_t seg, st_size_t flags )
+{
+    st_t      mem;
+    st_size_t size;
+
+    sm_seg_span( sm, seg, &mem, &size );
+
+    if ( size == 0 ) {
+        return 1;
+    }
+
+    if ( flags & SM_RESERVE_PREFAULT ) {
+        volatile char* p;
+        st_size_t      page;
+        st_size_t      off;
+
+        p = mem;
+        page = sysconf( _SC_PAGESIZE );
+
+        for ( off = 0; off < size; off += page ) {
+            p[ off ] = p[ off ];
+        }
+        p[ size - 1 ] = p[ size - 1 ];
+    }
+
+    if ( flags & SM_RESERVE_LOCK ) {
+        if ( mlock( mem, size ) != 0 ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/**
+ * Return extension state, and create it if missing.
+ *
+ * @param sm Segman.
+ *
+ * @return Extension (or NULL if allocation failed).
+ */
+static sm_ext_t sm_ext_get( sm_t sm )
+{
+    if ( sm->ext == NULL ) {
+        sm->ext = st_alloc( sizeof( sm_ext_s ) );
+        if ( sm->ext ) {
+            sm_tail_t cur;
+            st_t      mem;
+            st_size_t size;
+
+            memset( sm->ext, 0, sizeof( sm_ext_s ) );
+            sm->ext->sm = sm;
+            sm->ext->color = sm_color_next( sm );
+
+            /* Segments from before extension. */
+            for ( cur = &sm->host; cur; cur = cur->next ) {
+                sm_seg_span( sm, cur, &mem, &size );
+                sm_reg_count( sm, cur, size, 1 );
+            }
+            pthread_mutex_init( &sm->ext->lock, NULL );
+            pthread_cond_init( &sm->ext->cond, NULL );
+            pthread_cond_init( &sm->ext->wait_cond, NULL );
+        }
+    }
+
+    return sm->ext;
+}
+
+
+/**
+ * Destroy extension state.
+ *
+ * @param sm Segman.
+ *
+ * @return NA
+ */
+static st_none sm_ext_del( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm->ext;
+
+    if ( ext == NULL ) {
+        return;
+    }
+
+    sm_provision_stop( sm );
+    sm_reg_rem( ext );
+
+    if ( ext->trace ) {
+        sm_trace_del( ext->trace );
+    }
+
+    if ( ext->prof ) {
+        sm_profile_stop( sm );
+    }
+
+    if ( ext->ebr ) {
+        sm_bag_t bag;
+        sm_ebr_clear( ext->ebr, 0 );
+        sm_ebr_clear( ext->ebr, 1 );
+        sm_ebr_clear( ext->ebr, 2 );
+        while ( ext->ebr->spare ) {
+            bag = ext->ebr->spare;
+            ext->ebr->spare = bag->next;
+            st_del( bag );
+        }
+        st_del( ext->ebr );
+    }
+
+    sm_dec_clear( ext );
+
+    while ( ext->run ) {
+        sm_run_t run;
+        run = ext->run;
+        ext->run = run->next;
+        sm_free_seg( sm, run->seg );
+        st_del( run );
+    }
+
+    if ( ext->state == SM_PROV_READY ) {
+        sm_free_seg( sm, ext->spare );
+    }
+
+    sm_budget_leave( sm );
+
+    if ( ext->efd_on ) {
+        close( ext->efd );
+    }
+
+    pthread_cond_destroy( &ext->wait_cond );
+    pthread_cond_destroy( &ext->cond );
+    pthread_mutex_destroy( &ext->lock );
+
+    st_del( ext );
+    sm->ext = NULL;
+    sm->flags &= ~( SM_FLAG_LOWAT | SM_FLAG_OBJECT | SM_FLAG_TRACE | SM_FLAG_ZERO );
+}
+
+
+/**
+ * Wake a thread in sm_get_wait() and signal readiness eventfd, when
+ * pool becomes non-empty.
+ *
+ * @param sm Segman.
+ *
+ * @return NA
+ */
+static st_none sm_wake( sm_t sm )
+{
+    uint64_t one;
+
+    if ( sm->ext->waiters ) {
+        pthread_cond_signal( &sm->ext->wait_cond );
+    }
+
+    if ( sm->ext->efd_on ) {
+        one = 1;
+        if ( write( sm->ext->efd, &one, sizeof( one ) ) < 0 ) {
+            /* Counter is saturated, i.e. readiness is pending. */
+        }
+    }
+}
+
+
+/**
+ * Check if pool is empty, i.e. sm_get() would need a new Segment.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if empty (0 otherwise).
+ */
+static inline st_size_t sm_is_empty( sm_t sm )
+{
+    return sm->head == NULL && sm->tail->next == NULL;
+}
+
+
+/**
+ * Wake waiters, if slots were added to an empty pool by other means
+ * than sm_put().
+ *
+ * @param sm    Segman.
+ * @param empty Pool was empty before slots were added.
+ *
+ * @return NA
+ */
+static st_none sm_wake_added( sm_t sm, st_size_t empty )
+{
+    if ( empty && !sm_is_empty( sm ) && sm->ext && ( sm->ext->waiters | sm->ext->efd_on ) ) {
+        sm_wake( sm );
+    }
+}
+
+
+/**
+ * Charge Segment allocation to budget. If budget is exhausted, wait
+ * for other Segmans to release memory (if waiting is enabled).
+ *
+ * @param sm   Segman.
+ * @param size Allocation size.
+ *
+ * @return 1 on success (0 if budget is exhausted).
+ */
+static st_size_t sm_budget_charge( sm_t sm, st_size_t size )
+{
+    sm_budget_t     bg;
+    st_size_t       used;
+    st_size_t       ret;
+    struct timespec ts;
+
+    bg = sm->ext->budget;
+    ret = 0;
+
+    used = __atomic_load_n( &bg->used, __ATOMIC_RELAXED );
+    while ( used + size <= bg->limit ) {
+        if ( __atomic_compare_exchange_n(
+                 &bg->used, &used, used + size, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) {
+            ret = 1;
+            break;
+        }
+    }
+
+    if ( ret == 0 && bg->wait_ms ) {
+
+        clock_gettime( CLOCK_REALTIME, &ts );
+        ts.tv_sec += bg->wait_ms / 1000;
+        ts.tv_nsec += ( bg->wait_ms % 1000 ) * 1000000;
+        if ( ts.tv_nsec >= 1000000000 ) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        /* Releases signal under the lock, hence no wakeup is lost. */
+        pthread_mutex_lock( &bg->lock );
+        for ( ;; ) {
+            used = __atomic_load_n( &bg->used, __ATOMIC_RELAXED );
+            if ( used + size <= bg->limit ) {
+                if ( __atomic_compare_exchange_n(
+                         &bg->used, &used, used + size, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) {
+                    ret = 1;
+                    break;
+                }
+            } else if ( pthread_cond_timedwait( &bg->cond, &bg->lock, &ts ) == ETIMEDOUT ) {
+                break;
+            }
+        }
+        pthread_mutex_unlock( &bg->lock );
+    }
+
+    if ( ret ) {
+        __atomic_add_fetch( &sm->ext->budget_used, size, __ATOMIC_RELAXED );
+    }
+
+    return ret;
+}
+
+
+/**
+ * Release Segment allocation from budget.
+ *
+ * @param sm   Segman.
+ * @param size Allocation size.
+ *
+ * @return NA
+ */
+static st_none sm_budget_release( sm_t sm, st_size_t size )
+{
+    sm_budget_t bg;
+
+    bg = sm->ext->budget;
+
+    __atomic_sub_fetch( &sm->ext->budget_used, size, __ATOMIC_RELAXED );
+    __atomic_sub_fetch( &bg->used, size, __ATOMIC_RELEASE );
+
+    if ( bg->wait_ms ) {
+        pthread_mutex_lock( &bg->lock );
+        pthread_cond_broadcast( &bg->cond );
+        pthread_mutex_unlock( &bg->lock );
+    }
+}
+
+
+/**
+ * Detach Segman from budget and release all its charges.
+ *
+ * @param sm Segman.
+ *
+ * @return NA
+ */
+static st_none sm_budget_leave( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm->ext;
+
+    if ( ext->budget == NULL ) {
+        return;
+    }
+
+    sm_budget_release( sm, ext->budget_used );
+    __atomic_sub_fetch( &ext->budget->pool_cnt, 1, __ATOMIC_RELAXED );
+    ext->budget = NULL;
+}
+
+
+/**
+ * Release Tail Segments (and run Segments) that have only free
+ * slots. Free slots are marked to a bitmap, as in sm_decommit(), and
+ * the free list of the remaining Segments is rebuilt, lowest address
+ * first.
+ *
+ * Free list is kept as is, if it has slots outside of the Segments
+ * (stolen or decommitted).
+ *
+ * @param sm Segman.
+ *
+ * @return Number of released bytes.
+ */
+static st_size_t sm_trim_empty( sm_t sm )
+{
+    sm_ext_t     ext;
+    sm_seg_ref_t ref;
+    sm_seg_ref_t r;
+    sm_tail_t*   seg;
+    sm_tail_t    prev;
+    sm_tail_t    cur;
+    sm_run_t*    run;
+    sm_run_t     done;
+    uint64_t*    map;
+    st_size_t*   bit;
+    st_size_t    ref_cnt;
+    st_size_t    word_cnt;
+    st_size_t    uninit;
+    st_size_t    free_cnt;
+    st_size_t    limit;
+    st_size_t    off;
+    st_size_t    cnt;
+    st_size_t    ret;
+    st_size_t    idx;
+    st_size_t    i;
+    st_size_t    j;
+    st_t         slot;
+    st_t         next;
+    st_t         mem;
+    st_size_t    size;
+
+    ext = sm->ext;
+    ret = 0;
+
+    if ( ext ) {
+
+        /* Run Segments without used slots. */
+        run = &ext->run;
+        while ( *run ) {
+            if ( ( *run )->used_cnt == 0 ) {
+                done = *run;
+                *run = done->next;
+                sm_seg_span( sm, done->seg, &mem, &size );
+                ret += size;
+                sm_free_seg( sm, done->seg );
+                st_del( done );
+            } else {
+                run = &( *run )->next;
+            }
+        }
+
+        if ( ext->dec || ext->foreign ) {
+            return ret;
+        }
+
+        if ( ext->zero_head ) {
+            /* Cleared slots are free slots too. */
+            sm_zero_splice( sm );
+        }
+    }
+
+    if ( sm->tail == &sm->host ) {
+        return ret;
+    }
+
+    off = ( sm->flags & SM_FLAG_OBJECT ) ? ext->link_off : 0;
+
+    ref = sm_seg_refs( sm, sm->tail, &ref_cnt );
+    if ( ref == NULL ) {
+        return ret;
+    }
+
+    word_cnt = 0;
+    for ( i = 0; i < ref_cnt; i++ ) {
+        word_cnt += ref[ i ].seg->tail_cnt;
+    }
+    word_cnt = ( word_cnt + 63 ) / 64;
+
+    /* Bitmap, and Segments with first bit, in Segment order. */
+    map = st_alloc( word_cnt * sizeof( uint64_t ) + ref_cnt * ( sizeof( sm_tail_t ) + sizeof( st_size_t ) ) );
+    if ( map == NULL ) {
+        st_del( ref );
+        return ret;
+    }
+
+    memset( map, 0, word_cnt * sizeof( uint64_t ) );
+    seg = (sm_tail_t*)( map + word_cnt );
+    bit = (st_size_t*)( seg + ref_cnt );
+
+    for ( i = 0; i < ref_cnt; i++ ) {
+        seg[ ref[ i ].num ] = ref[ i ].seg;
+        bit[ ref[ i ].num ] = ref[ i ].bit;
+    }
+
+    /* Mark free slots: linked and uninitialized. */
+    uninit = sm->tail->tail_cnt - sm->tail->init_cnt;
+
+    slot = sm->head;
+    for ( i = 0; i < sm->free_cnt - uninit; i++ ) {
+        r = sm_seg_find( ref, ref_cnt, (uintptr_t)slot );
+        if ( r == NULL ) {
+            st_del( map );
+            st_del( ref );
+            return ret;
+        }
+        idx = r->bit + ( (uintptr_t)slot - r->base ) / sm->slot_size;
+        SM_BIT_SET( map, idx );
+        slot = *( (st_p)( slot + off ) );
+    }
+
+    for ( j = sm->tail->init_cnt; j < sm->tail->tail_cnt; j++ ) {
+        SM_BIT_SET( map, bit[ ref_cnt - 1 ] + j );
+    }
+
+    st_del( ref );
+
+    /* Empty Tail Segments are dropped from the Segment list. */
+    cnt = 0;
+    for ( i = 1; i < ref_cnt; i++ ) {
+        for ( j = 0; j < seg[ i ]->tail_cnt && SM_BIT_GET( map, bit[ i ] + j ); j++ )
+            ;
+        if ( j == seg[ i ]->tail_cnt ) {
+            cnt++;
+        } else {
+            seg[ i - cnt ] = seg[ i ];
+            bit[ i - cnt ] = bit[ i ];
+        }
+    }
+
+    if ( cnt == 0 ) {
+        st_del( map );
+        return ret;
+    }
+
+    /* Release (links are not used anymore). */
+    prev = &sm->host;
+    for ( i = 1; prev != sm->tail; ) {
+        cur = prev->next;
+        if ( i < ref_cnt - cnt && seg[ i ] == cur ) {
+            prev = cur;
+            i++;
+        } else {
+            prev->next = cur->next;
+            if ( cur == sm->tail ) {
+                sm->tail = prev;
+            }
+            sm_seg_span( sm, cur, &mem, &size );
+            ret += size;
+            sm_free_seg( sm, cur );
+        }
+    }
+    ref_cnt -= cnt;
+
+    /*
+     * Rebuild free list. The list continues to the uninitialized
+     * slots of tail, if tail was kept.
+     */
+    uninit = sm->tail->tail_cnt - sm->tail->init_cnt;
+    next = uninit ? sm->tail->base + sm->tail->init_cnt * sm->slot_size : NULL;
+    free_cnt = uninit;
+
+    for ( i = ref_cnt; i-- > 0; ) {
+        limit = ( seg[ i ] == sm->tail ) ? sm->tail->init_cnt : seg[ i ]->tail_cnt;
+        for ( j = limit; j-- > 0; ) {
+            if ( SM_BIT_GET( map, bit[ i ] + j ) ) {
+                slot = seg[ i ]->base + j * sm->slot_size;
+                *( (st_p)( slot + off ) ) = next;
+                next = slot;
+                free_cnt++;
+            }
+        }
+    }
+
+    sm->head = next;
+    sm->free_cnt = free_cnt;
+
+    if ( ext ) {
+        /* Never used slots might not be taken in order anymore. */
+        ext->zero_next = NULL;
+    }
+
+    st_del( map );
+
+    return ret;
+}
+
+
+/**
+ * Request provisioning if free slots are below low-water mark and
+ * there are no more Segments to use.
+ *
+ * @param sm Segman.
+ *
+ * @return NA
+ */
+static st_none sm_low_water( sm_t sm )
+{
+    sm_ext_t  ext;
+    st_size_t state;
+
+    ext = sm->ext;
+
+    if ( sm->free_cnt >= ext->lowat || sm->tail->next != NULL ) {
+        return;
+    }
+
+    if ( __atomic_load_n( &ext->state, __ATOMIC_RELAXED ) != SM_PROV_IDLE ) {
+        return;
+    }
+
+    state = SM_PROV_IDLE;
+    if ( __atomic_compare_exchange_n(
+             &ext->state, &state, SM_PROV_WANT, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED )
+         && ext->running ) {
+        pthread_mutex_lock( &ext->lock );
+        pthread_cond_signal( &ext->cond );
+        pthread_mutex_unlock( &ext->lock );
+    }
+}
+
+
+/**
+ * Take provisioned Segment into use.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if Segment was available (0 otherwise).
+ */
+static st_size_t sm_use_spare( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm->ext;
+
+    if ( __atomic_load_n( &ext->state, __ATOMIC_ACQUIRE ) != SM_PROV_READY ) {
+        return 0;
+    }
+
+    sm_link_seg( sm, ext->spare );
+    ext->spare = NULL;
+    __atomic_store_n( &ext->state, SM_PROV_IDLE, __ATOMIC_RELEASE );
+
+    return 1;
+}
+
+
+/**
+ * Provisioning thread main loop.
+ *
+ * @param arg Segman.
+ *
+ * @return NULL.
+ */
+static st_t sm_provision_main( st_t arg )
+{
+    sm_t     sm;
+    sm_ext_t ext;
+
+    sm = arg;
+    ext = sm->ext;
+
+    pthread_mutex_lock( &ext->lock );
+
+    while ( ext->running ) {
+        if ( __atomic_load_n( &ext->state, __ATOMIC_ACQUIRE ) == SM_PROV_WANT ) {
+            pthread_mutex_unlock( &ext->lock );
+            sm_maintain( sm );
+            pthread_mutex_lock( &ext->lock );
+        } else {
+            pthread_cond_wait( &ext->cond, &ext->lock );
+        }
+    }
+
+    pthread_mutex_unlock( &ext->lock );
+
+    return NULL;
+}
+
+
+/**
+ * Return cache of CPU.
+ *
+ * @param smc Front end.
+ * @param cpu CPU.
+ *
+ * @return Cache.
+ */
+static inline sm_shard_t sm_shard( sm_cpu_t smc, st_size_t cpu )
+{
+    return smc->shards + cpu * smc->stride;
+}
+
+
+#ifdef SM_USE_RSEQ
+
+/*
+ * rseq critical sections. The section is restarted through the abort
+ * handler if the thread is preempted or migrated before the commit
+ * store, hence the cache is only updated on the CPU it belongs to.
+ */
+
+/** Define rseq_cs descriptor (label 3) for section between 1 and 2. */
+#define SM_RSEQ_CS                                                                       \
+    ".pushsection __rseq_cs, \"aw\"\n\t"                                                 \
+    ".balign 32\n\t"                                                                     \
+    "3:\n\t"                                                                             \
+    ".long 0x0, 0x0\n\t"                                                                 \
+    ".quad 1f, (2f - 1f), 4f\n\t"                                                        \
+    ".popsection\n\t"                                                                    \
+    "leaq 3b(%%rip), %%rax\n\t"                                                          \
+    "movq %%rax, %[rseq_cs]\n\t"
+
+/** Define abort handler (label 4), preceded by the signature. */
+#define SM_RSEQ_ABORT                                                                    \
+    ".pushsection __rseq_failure, \"ax\"\n\t"                                            \
+    ".byte 0x0f, 0xb9, 0x3d\n\t"                                                         \
+    ".long 0x53053053\n\t"                                                               \
+    "4:\n\t"                                                                             \
+    "jmp %l[abort]\n\t"                                                                  \
+    ".popsection\n\t"
+
+
+/**
+ * Return rseq area of the thread.
+ *
+ * @return rseq area.
+ */
+static inline struct rseq* sm_rseq_area( void )
+{
+    return (struct rseq*)( (char*)__builtin_thread_pointer() + __rseq_offset );
+}
+
+
+/**
+ * Pop slot from cache of "cpu".
+ *
+ * @param rs    rseq area.
+ * @param cpu   Expected CPU.
+ * @param shard Cache of CPU.
+ * @param slot  Popped slot (output).
+ *
+ * @return 1 on success, 0 if cache is empty, -1 if aborted.
+ */
+static inline st_id_t sm_rseq_pop( struct rseq* rs, uint32_t cpu, sm_shard_t shard, st_t* slot )
+{
+    __asm__ __volatile__ goto( SM_RSEQ_CS
+                               "1:\n\t"
+                               "cmpl %[cpu], %[cpu_id]\n\t"
+                               "jnz 4f\n\t"
+                               "movq %[cur], %%rax\n\t"
+                               "testq %%rax, %%rax\n\t"
+                               "jz %l[empty]\n\t"
+                               "movq -8(%[slots], %%rax, 8), %%rcx\n\t"
+                               "movq %%rcx, (%[out])\n\t"
+                               "decq %%rax\n\t"
+                               "movq %%rax, %[cur]\n\t"
+                               "2:\n\t" SM_RSEQ_ABORT
+                               :
+                               : [cpu_id] "m"( rs->cpu_id ),
+                                 [rseq_cs] "m"( rs->rseq_cs ),
+                                 [cpu] "r"( cpu ),
+                                 [cur] "m"( shard->cur ),
+                                 [slots] "r"( shard->slot ),
+                                 [out] "r"( slot )
+                               : "memory", "cc", "rax", "rcx"
+                               : abort, empty );
+    return 1;
+abort:
+    return -1;
+empty:
+    return 0;
+}
+
+
+/**
+ * Push slot to cache of "cpu".
+ *
+ * @param rs    rseq area.
+ * @param cpu   Expected CPU.
+ * @param shard Cache of CPU.
+ * @param cap   Cache capacity.
+ * @param slot  Slot.
+ *
+ * @return 1 on success, 0 if cache is full, -1 if aborted.
+ */
+static inline st_id_t sm_rseq_push(
+    struct rseq* rs, uint32_t cpu, sm_shard_t shard, st_size_t cap, st_t slot )
+{
+    __asm__ __volatile__ goto( SM_RSEQ_CS
+                               "1:\n\t"
+                               "cmpl %[cpu], %[cpu_id]\n\t"
+                               "jnz 4f\n\t"
+                               "movq %[cur], %%rax\n\t"
+                               "cmpq %[cap], %%rax\n\t"
+                               "jae %l[full]\n\t"
+                               "movq %[slot], (%[slots], %%rax, 8)\n\t"
+                               "incq %%rax\n\t"
+                               "movq %%rax, %[cur]\n\t"
+                               "2:\n\t" SM_RSEQ_ABORT
+                               :
+                               : [cpu_id] "m"( rs->cpu_id ),
+                                 [rseq_cs] "m"( rs->rseq_cs ),
+                                 [cpu] "r"( cpu ),
+                                 [cur] "m"( shard->cur ),
+                                 [cap] "r"( cap ),
+                                 [slots] "r"( shard->slot ),
+                                 [slot] "r"( slot )
+                               : "memory", "cc", "rax"
+                               : abort, full );
+    return 1;
+abort:
+    return -1;
+full:
+    return 0;
+}
+
+#endif
+
+
+/**
+ * Lock cache (without rseq).
+ *
+ * @param shard Cache.
+ *
+ * @return NA
+ */
+static inline st_none sm_shard_lock( sm_shard_t shard )
+{
+    while ( __atomic_exchange_n( &shard->lock, 1, __ATOMIC_ACQUIRE ) ) {
+        while ( __atomic_load_n( &shard->lock, __ATOMIC_RELAXED ) ) {
+            sched_yield();
+        }
+    }
+}
+
+
+/**
+ * Pop slot from cache of current CPU.
+ *
+ * @param smc  Front end.
+ * @param slot Popped slot (output).
+ *
+ * @return 1 on success (0 if cache is empty).
+ */
+static st_size_t sm_shard_pop( sm_cpu_t smc, st_t* slot )
+{
+    sm_shard_t shard;
+    st_size_t  ret;
+    int        cpu;
+
+#ifdef SM_USE_RSEQ
+    if ( smc->rseq ) {
+
+        struct rseq* rs;
+        uint32_t     rcpu;
+        st_id_t      rret;
+
+        rs = sm_rseq_area();
+
+        do {
+            rcpu = __atomic_load_n( &rs->cpu_id_start, __ATOMIC_RELAXED );
+            if ( rcpu >= smc->shard_cnt ) {
+                return 0;
+            }
+            rret = sm_rseq_pop( rs, rcpu, sm_shard( smc, rcpu ), slot );
+        } while ( rret < 0 );
+
+        return rret;
+    }
+#endif
+
+    cpu = sched_getcpu();
+    if ( cpu < 0 || (st_size_t)cpu >= smc->shard_cnt ) {
+        return 0;
+    }
+
+    shard = sm_shard( smc, cpu );
+    ret = 0;
+
+    sm_shard_lock( shard );
+    if ( shard->cur > 0 ) {
+        shard->cur--;
+        *slot = shard->slot[ shard->cur ];
+        ret = 1;
+    }
+    __atomic_store_n( &shard->lock, 0, __ATOMIC_RELEASE );
+
+    return ret;
+}
+
+
+/**
+ * Push slot to cache of current CPU.
+ *
+ * @param smc  Front end.
+ * @param slot Slot.
+ *
+ * @return 1 on success (0 if cache is full).
+ */
+static st_size_t sm_shard_push( sm_cpu_t smc, st_t slot )
+{
+    sm_shard_t shard;
+    st_size_t  ret;
+    int        cpu;
+
+#ifdef SM_USE_RSEQ
+    if ( smc->rseq ) {
+
+        struct rseq* rs;
+        uint32_t     rcpu;
+        st_id_t      rret;
+
+        rs = sm_rseq_area();
+
+        do {
+            rcpu = __atomic_load_n( &rs->cpu_id_start, __ATOMIC_RELAXED );
+            if ( rcpu >= smc->shard_cnt ) {
+                return 0;
+            }
+            rret = sm_rseq_push( rs, rcpu, sm_shard( smc, rcpu ), smc->cache_cnt, slot );
+        } while ( rret < 0 );
+
+        return rret;
+    }
+#endif
+
+    cpu = sched_getcpu();
+    if ( cpu < 0 || (st_size_t)cpu >= smc->shard_cnt ) {
+        return 0;
+    }
+
+    shard = sm_shard( smc, cpu );
+    ret = 0;
+
+    sm_shard_lock( shard );
+    if ( shard->cur < smc->cache_cnt ) {
+        shard->slot[ shard->cur ] = slot;
+        shard->cur++;
+        ret = 1;
+    }
+    __atomic_store_n( &shard->lock, 0, __ATOMIC_RELEASE );
+
+    return ret;
+}
+
+
+/**
+ * Get slot from Segman and refill the cache of current CPU with a
+ * batch of slots.
+ *
+ * @param smc Front end.
+ *
+ * @return Memory slot (or NULL if memory pool is exhausted).
+ */
+static st_t sm_cpu_refill( sm_cpu_t smc )
+{
+    st_t      batch[ SM_CPU_BATCH_CNT ];
+    st_size_t batch_cnt;
+    st_size_t cnt;
+    st_size_t i;
+    st_t      ret;
+
+    batch_cnt = smc->cache_cnt / 2;
+    if ( batch_cnt > SM_CPU_BATCH_CNT ) {
+        batch_cnt = SM_CPU_BATCH_CNT;
+    }
+
+    pthread_mutex_lock( &smc->lock );
+    ret = sm_get( smc->sm );
+    for ( cnt = 0; ret && cnt < batch_cnt; cnt++ ) {
+        batch[ cnt ] = sm_get( smc->sm );
+        if ( batch[ cnt ] == NULL ) {
+            break;
+        }
+    }
+    pthread_mutex_unlock( &smc->lock );
+
+    for ( i = 0; i < cnt; i++ ) {
+        if ( !sm_shard_push( smc, batch[ i ] ) ) {
+            break;
+        }
+    }
+
+    if ( i < cnt ) {
+        /* Migrated or raced, return the rest. */
+        pthread_mutex_lock( &smc->lock );
+        for ( ; i < cnt; i++ ) {
+            sm_put( smc->sm, batch[ i ] );
+        }
+        pthread_mutex_unlock( &smc->lock );
+    }
+
+    return ret;
+}
+
+
+/**
+ * Put slot to Segman together with a batch of slots from the cache of
+ * current CPU.
+ *
+ * @param smc  Front end.
+ * @param slot Slot.
+ *
+ * @return NA
+ */
+static st_none sm_cpu_drain( sm_cpu_t smc, st_t slot )
+{
+    st_t      batch[ SM_CPU_BATCH_CNT ];
+    st_size_t batch_cnt;
+    st_size_t cnt;
+    st_size_t i;
+
+    batch_cnt = smc->cache_cnt / 2;
+    if ( batch_cnt > SM_CPU_BATCH_CNT ) {
+        batch_cnt = SM_CPU_BATCH_CNT;
+    }
+
+    for ( cnt = 0; cnt < batch_cnt; cnt++ ) {
+        if ( !sm_shard_pop( smc, &batch[ cnt ] ) ) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock( &smc->lock );
+    sm_put( smc->sm, slot );
+    for ( i = 0; i < cnt; i++ ) {
+        sm_put( smc->sm, batch[ i ] );
+    }
+    pthread_mutex_unlock( &smc->lock );
+}
+
+
+/**
+ * Advance epoch, if all active readers are in the current epoch, and
+ * put slots that were deferred two epochs ago to the free list. The
+ * slots are spliced to the free list as one chain. Epoch is advanced
+ * at most twice, which reclaims all deferred slots if there are no
+ * active readers.
+ *
+ * @param sm Segman.
+ *
+ * @return Number of reclaimed slots.
+ */
+static st_size_t sm_ebr_reclaim( sm_t sm )
+{
+    sm_ebr_t  ebr;
+    sm_bag_t  bag;
+    st_size_t epoch;
+    st_size_t state;
+    st_size_t empty;
+    st_size_t off;
+    st_size_t e;
+    st_size_t cnt;
+    st_size_t ret;
+    st_size_t round;
+    st_size_t i;
+
+    ebr = sm->ext->ebr;
+    ebr->pending = 0;
+    off = ( sm->flags & SM_FLAG_OBJECT ) ? sm->ext->link_off : 0;
+    empty = sm_is_empty( sm );
+    ret = 0;
+
+    for ( round = 0; round < 2; round++ ) {
+
+        if ( ebr->cnt[ 0 ] + ebr->cnt[ 1 ] + ebr->cnt[ 2 ] == 0 ) {
+            break;
+        }
+
+        /* Order the unlinking of deferred slots before reader checks. */
+        __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+        epoch = ebr->epoch;
+
+        for ( i = 0; i < SM_READER_MAX; i++ ) {
+            state = __atomic_load_n( &ebr->reader[ i ].state, __ATOMIC_SEQ_CST );
+            if ( ( state & 1 ) && ( state >> 1 ) != epoch ) {
+                return ret;
+            }
+        }
+
+        epoch++;
+        __atomic_store_n( &ebr->epoch, epoch, __ATOMIC_SEQ_CST );
+
+        /* List of epoch-2, i.e. the next list. */
+        e = ( epoch + 1 ) % 3;
+        cnt = ebr->cnt[ e ];
+
+        if ( cnt == 0 ) {
+            continue;
+        }
+
+        /* Link the slots as with sm_put(), but update counts once. */
+        for ( bag = ebr->bag[ e ]; bag; bag = bag->next ) {
+            for ( i = 0; i < bag->cnt; i++ ) {
+                *( (st_p)( bag->slot[ i ] + off ) ) = sm->head;
+                sm->head = bag->slot[ i ];
+#ifdef SEGMAN_USE_PROFILE
+                if ( ( sm->flags & SM_FLAG_PROFILE ) && sm->ext->prof->sample_cnt ) {
+                    sm_prof_put( sm->ext->prof, bag->slot[ i ] );
+                }
+#endif
+            }
+        }
+
+        sm->used_cnt -= cnt;
+        sm->free_cnt += cnt;
+
+        sm_ebr_clear( ebr, e );
+
+        sm_wake_added( sm, empty );
+        empty = 0;
+
+        ret += cnt;
     }
 
-    sm->used_cnt--;
-    sm->free_cnt++;
+    return ret;
+}
+
+
+/**
+ * Drop deferred slots of epoch list, and keep the bags for re-use.
+ *
+ * @param ebr Reclamation state.
+ * @param e   Epoch list.
+ *
+ * @return NA
+ */
+static st_none sm_ebr_clear( sm_ebr_t ebr, st_size_t e )
+{
+    sm_bag_t bag;
+
+    while ( ebr->bag[ e ] ) {
+        bag = ebr->bag[ e ];
+        ebr->bag[ e ] = bag->next;
+        bag->next = ebr->spare;
+        ebr->spare = bag;
+    }
+
+    ebr->cnt[ e ] = 0;
+}
+
+
+/**
+ * Create run Segment and add it last in the run list.
+ *
+ * @param sm Segman.
+ *
+ * @return Run Segment (or NULL if allocation failed).
+ */
+static sm_run_t sm_run_new( sm_t sm )
+{
+    sm_tail_t seg;
+    sm_run_t  run;
+    sm_run_t* last;
+    st_size_t word_cnt;
+
+    seg = sm_alloc_seg( sm, sm_tail_slots( sm ) );
+    if ( seg == NULL ) {
+        return NULL;
+    }
+
+    word_cnt = ( seg->tail_cnt + 63 ) / 64;
+
+    run = st_alloc( sizeof( sm_run_s ) + word_cnt * sizeof( uint64_t ) );
+    if ( run == NULL ) {
+        sm_free_seg( sm, seg );
+        return NULL;
+    }
+
+    /* Run slots are not linked, hence they are considered prepared. */
+    seg->init_cnt = seg->tail_cnt;
+
+    run->seg = seg;
+    run->word_cnt = word_cnt;
+    sm_run_clear( run );
+
+    /* Older Segments are filled first. */
+    run->next = NULL;
+    for ( last = &sm->ext->run; *last; last = &( *last )->next ) {
+    }
+    *last = run;
+
+    return run;
+}
+
+
+/**
+ * Mark all slots in run Segment as free.
+ *
+ * @param run Run Segment.
+ *
+ * @return NA
+ */
+static st_none sm_run_clear( sm_run_t run )
+{
+    st_size_t tail;
+
+    memset( run->map, 0, run->word_cnt * sizeof( uint64_t ) );
+    run->used_cnt = 0;
+
+    /* Bits after the last slot are never free. */
+    tail = run->seg->tail_cnt % 64;
+    if ( tail != 0 ) {
+        run->map[ run->word_cnt - 1 ] = ~(uint64_t)0 << tail;
+    }
+}
+
+
+/**
+ * Find "n" contiguous free slots. Each bitmap word is tested for all
+ * start positions at once, by and-ing the free mask with itself
+ * shifted by 1..n-1 (with bits from the next word).
+ *
+ * @param run Run Segment.
+ * @param n   Number of slots (max 64).
+ *
+ * @return Index of first slot (or -1 if not found).
+ */
+static st_id_t sm_run_find( sm_run_t run, st_size_t n )
+{
+    uint64_t  lo;
+    uint64_t  hi;
+    uint64_t  start;
+    st_size_t i;
+    st_size_t k;
+
+    for ( i = 0; i < run->word_cnt; i++ ) {
+
+        lo = ~run->map[ i ];
+        if ( lo == 0 ) {
+            continue;
+        }
+
+        hi = ( i + 1 < run->word_cnt ) ? ~run->map[ i + 1 ] : 0;
+
+        start = lo;
+        for ( k = 1; k < n && start; k++ ) {
+            start &= ( lo >> k ) | ( hi << ( 64 - k ) );
+        }
+
+        if ( start ) {
+            return i * 64 + __builtin_ctzll( start );
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Mark slots as used or free.
+ *
+ * @param run  Run Segment.
+ * @param idx  First slot.
+ * @param n    Number of slots.
+ * @param used 1 for used (0 for free).
+ *
+ * @return NA
+ */
+static st_none sm_run_mark( sm_run_t run, st_size_t idx, st_size_t n, st_size_t used )
+{
+    st_size_t cnt;
+    uint64_t  mask;
+
+    while ( n > 0 ) {
+
+        cnt = 64 - ( idx % 64 );
+        if ( cnt > n ) {
+            cnt = n;
+        }
+
+        mask = ( cnt == 64 ) ? ~(uint64_t)0 : ( ( (uint64_t)1 << cnt ) - 1 ) << ( idx % 64 );
+
+        if ( used ) {
+            run->map[ idx / 64 ] |= mask;
+        } else {
+            run->map[ idx / 64 ] &= ~mask;
+        }
+
+        idx += cnt;
+        n -= cnt;
+    }
+}
+
+
+/**
+ * Check that slots are all used.
+ *
+ * @param run Run Segment.
+ * @param idx First slot.
+ * @param n   Number of slots.
+ *
+ * @return 1 if used (0 otherwise).
+ */
+static st_size_t sm_run_used( sm_run_t run, st_size_t idx, st_size_t n )
+{
+    st_size_t cnt;
+    uint64_t  mask;
+
+    while ( n > 0 ) {
+
+        cnt = 64 - ( idx % 64 );
+        if ( cnt > n ) {
+            cnt = n;
+        }
+
+        mask = ( cnt == 64 ) ? ~(uint64_t)0 : ( ( (uint64_t)1 << cnt ) - 1 ) << ( idx % 64 );
+
+        if ( ( run->map[ idx / 64 ] & mask ) != mask ) {
+            return 0;
+        }
+
+        idx += cnt;
+        n -= cnt;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Add Segman to registry (if not already).
+ *
+ * @param sm Segman.
+ *
+ * @return NA
+ */
+static st_none sm_reg_add( sm_t sm )
+{
+    sm_ext_t ext;
+
+    ext = sm_ext_get( sm );
+
+    if ( ext == NULL ) {
+        return;
+    }
+
+    pthread_mutex_lock( &sm_reg_lock );
+
+    if ( !ext->reg ) {
+        ext->reg = 1;
+        ext->reg_prev = NULL;
+        ext->reg_next = sm_reg_head;
+        if ( sm_reg_head ) {
+            sm_reg_head->reg_prev = ext;
+        }
+        sm_reg_head = ext;
+    }
+
+    pthread_mutex_unlock( &sm_reg_lock );
+}
+
+
+/**
+ * Remove Segman extension from registry (if registered).
+ *
+ * @param ext Extension.
+ *
+ * @return NA
+ */
+static st_none sm_reg_rem( sm_ext_t ext )
+{
+    if ( !ext->reg ) {
+        return;
+    }
+
+    pthread_mutex_lock( &sm_reg_lock );
+
+    if ( ext->reg_prev ) {
+        ext->reg_prev->reg_next = ext->reg_next;
+    } else {
+        sm_reg_head = ext->reg_next;
+    }
+
+    if ( ext->reg_next ) {
+        ext->reg_next->reg_prev = ext->reg_prev;
+    }
+
+    ext->reg = 0;
+
+    pthread_mutex_unlock( &sm_reg_lock );
+}
+
+
+/**
+ * Count Segment to (or from) registry metrics. Host header is
+ * included, since it is next to the slot area, or within the block.
+ *
+ * @param sm   Segman.
+ * @param seg  Segment.
+ * @param size Segment span size.
+ * @param add  1 for new Segment (0 for released).
+ *
+ * @return NA
+ */
+static st_none sm_reg_count( sm_t sm, sm_tail_t seg, st_size_t size, st_size_t add )
+{
+    if ( seg == &sm->host ) {
+        size = ( sm->block_size == 0 ) ? sizeof( sm_s ) + size : sm->block_size;
+    }
+
+    if ( add ) {
+        __atomic_add_fetch( &sm->ext->seg_cnt, 1, __ATOMIC_RELAXED );
+        __atomic_add_fetch( &sm->ext->seg_bytes, size, __ATOMIC_RELAXED );
+    } else {
+        __atomic_sub_fetch( &sm->ext->seg_cnt, 1, __ATOMIC_RELAXED );
+        __atomic_sub_fetch( &sm->ext->seg_bytes, size, __ATOMIC_RELAXED );
+    }
+}
+
+
+/**
+ * Write Segman metrics. Counters are read without synchronization
+ * with the Segman user, hence they are a snapshot.
+ *
+ * @param fd     File descriptor.
+ * @param format Dump format (SM_DUMP_*).
+ * @param sm     Segman.
+ * @param first  First Segman in dump.
+ *
+ * @return NA
+ */
+static st_none sm_reg_write( int fd, st_size_t format, sm_t sm, st_size_t first )
+{
+    st_size_t   seg_cnt;
+    st_size_t   bytes;
+    st_size_t   used_cnt;
+    st_size_t   free_cnt;
+    char        name[ 2 * SM_NAME_MAX + 24 ];
+    const char* c;
+    char*       n;
+
+    /* Segments are owned by other threads, only counters are read. */
+    seg_cnt = __atomic_load_n( &sm->ext->seg_cnt, __ATOMIC_RELAXED );
+    bytes = __atomic_load_n( &sm->ext->seg_bytes, __ATOMIC_RELAXED );
+    used_cnt = __atomic_load_n( &sm->used_cnt, __ATOMIC_RELAXED );
+    free_cnt = sm_free_count( sm );
+
+    /* Escape name for both formats. */
+    n = name;
+    if ( sm->ext->name[ 0 ] == 0 ) {
+        n += sprintf( n, "%p", (void*)sm );
+    } else {
+        for ( c = sm->ext->name; *c; c++ ) {
+            if ( *c == '"' || *c == '\\' ) {
+                *n++ = '\\';
+                *n++ = *c;
+            } else if ( (unsigned char)*c < 0x20 ) {
+                *n++ = '_';
+            } else {
+                *n++ = *c;
+            }
+        }
+    }
+    *n = 0;
+
+    if ( format == SM_DUMP_JSON ) {
+
+        dprintf( fd,
+                 "%s{\"name\":\"%s\",\"slot_size\":%lu,\"total\":%lu,\"used\":%lu,"
+                 "\"free\":%lu,\"segments\":%lu,\"bytes\":%lu}",
+                 first ? "" : ",",
+                 name,
+                 (unsigned long)sm->slot_size,
+                 (unsigned long)( used_cnt + free_cnt ),
+                 (unsigned long)used_cnt,
+                 (unsigned long)free_cnt,
+                 (unsigned long)seg_cnt,
+                 (unsigned long)bytes );
+
+    } else {
+
+        dprintf( fd,
+                 "segman_slot_size{pool=\"%s\"} %lu\n"
+                 "segman_total_count{pool=\"%s\"} %lu\n"
+                 "segman_used_count{pool=\"%s\"} %lu\n"
+                 "segman_free_count{pool=\"%s\"} %lu\n"
+                 "segman_segment_count{pool=\"%s\"} %lu\n"
+                 "segman_bytes{pool=\"%s\"} %lu\n",
+                 name,
+                 (unsigned long)sm->slot_size,
+                 name,
+                 (unsigned long)( used_cnt + free_cnt ),
+                 name,
+                 (unsigned long)used_cnt,
+                 name,
+                 (unsigned long)free_cnt,
+                 name,
+                 (unsigned long)seg_cnt,
+                 name,
+                 (unsigned long)bytes );
+    }
+}
+
+
+/**
+ * Link a page worth of decommitted slots to the free list.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if slots were linked (0 otherwise).
+ */
+static st_size_t sm_recommit( sm_t sm )
+{
+    sm_ext_t  ext;
+    sm_dec_t  dec;
+    st_size_t n;
+    st_size_t i;
+    st_t      slot;
+
+    ext = sm->ext;
+    dec = ext->dec;
+
+    n = sysconf( _SC_PAGESIZE ) / sm->slot_size;
+    if ( n == 0 ) {
+        n = 1;
+    }
+    if ( n > dec->cnt ) {
+        n = dec->cnt;
+    }
+
+    slot = dec->slot;
+    for ( i = 1; i < n; i++ ) {
+        *( (st_p)slot ) = slot + sm->slot_size;
+        slot += sm->slot_size;
+    }
+    *( (st_p)slot ) = sm->head;
+
+    sm->head = dec->slot;
+    sm->free_cnt += n;
+    ext->dec_cnt -= n;
+
+    dec->slot += n * sm->slot_size;
+    dec->cnt -= n;
+
+    if ( dec->cnt == 0 ) {
+        ext->dec = dec->next;
+        st_del( dec );
+    }
+
+    return 1;
+}
+
+
+/**
+ * Drop decommitted slot ranges.
+ *
+ * @param ext Extension.
+ *
+ * @return NA
+ */
+static st_none sm_dec_clear( sm_ext_t ext )
+{
+    sm_dec_t dec;
+
+    while ( ext->dec ) {
+        dec = ext->dec;
+        ext->dec = dec->next;
+        st_del( dec );
+    }
+
+    ext->dec_cnt = 0;
+}
+
+
+/**
+ * Clear slot. Common slot sizes are cleared with constant size
+ * stores.
+ *
+ * @param slot Slot.
+ * @param size Slot size.
+ *
+ * @return NA
+ */
+static inline st_none sm_clear_slot( st_t slot, st_size_t size )
+{
+    switch ( size ) {
+        case 16: memset( slot, 0, 16 ); break;
+        case 32: memset( slot, 0, 32 ); break;
+        case 64: memset( slot, 0, 64 ); break;
+        case 128: memset( slot, 0, 128 ); break;
+        case 256: memset( slot, 0, 256 ); break;
+        case 512: memset( slot, 0, 512 ); break;
+        default: memset( slot, 0, size ); break;
+    }
+}
+
+
+/**
+ * Clear a batch of free slots, and move them from the free list to
+ * the list of cleared slots. Slots that have never been used are
+ * left in the free list.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if slots were cleared (0 otherwise).
+ */
+static st_size_t sm_zero_batch( sm_t sm )
+{
+    sm_ext_t  ext;
+    st_size_t linked;
+    st_size_t cnt;
+    st_t      slot;
+
+    ext = sm->ext;
+
+    /* Free slots in list, i.e. not the uninitialized ones of tail. */
+    linked = sm->free_cnt - ( sm->tail->tail_cnt - sm->tail->init_cnt );
+
+    for ( cnt = 0; cnt < SM_ZERO_BATCH_CNT && linked > 0; cnt++, linked-- ) {
+
+        slot = sm->head;
+        if ( slot == ext->zero_next ) {
+            break;
+        }
+
+        sm->free_cnt--;
+        if ( sm->free_cnt > 0 ) {
+            sm->head = *( (st_p)slot );
+        } else {
+            sm->head = NULL;
+        }
+
+        sm_clear_slot( slot, sm->slot_size );
+        *( (st_p)slot ) = ext->zero_head;
+        ext->zero_head = slot;
+        ext->zero_cnt++;
+    }
+
+    return cnt > 0;
+}
+
+
+/**
+ * Move cleared slots back to the free list.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if slots were moved (0 otherwise).
+ */
+static st_size_t sm_zero_splice( sm_t sm )
+{
+    sm_ext_t ext;
+    st_t     slot;
+
+    ext = sm->ext;
+
+    /* Cleared slots are linked already, find the last. */
+    for ( slot = ext->zero_head; *( (st_p)slot ); slot = *( (st_p)slot ) ) {
+    }
+
+    *( (st_p)slot ) = sm->head;
+    sm->head = ext->zero_head;
+    sm->free_cnt += ext->zero_cnt;
+
+    ext->zero_head = NULL;
+    ext->zero_cnt = 0;
+
+    return 1;
+}
+
+
+/**
+ * Release whole pages within address range.
+ *
+ * @param lo   Range start.
+ * @param hi   Range end.
+ * @param page Page size.
+ *
+ * @return NA
+ */
+static st_none sm_decommit_area( uintptr_t lo, uintptr_t hi, st_size_t page )
+{
+    lo = ( lo + page - 1 ) & ~( page - 1 );
+    hi = hi & ~( page - 1 );
+
+    if ( lo < hi ) {
+        madvise( (void*)lo, hi - lo, SM_DECOMMIT_ADVICE );
+    }
+}
+
+
+/**
+ * Return monotonic time in milliseconds.
+ *
+ * @return Time.
+ */
+static uint64_t sm_time_ms( void )
+{
+    struct timespec ts;
 
-    return sm;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 
-#ifdef SEGMAN_USE_HOOKS
+#ifdef SEGMAN_USE_TRACE
 
-void sm_set_get_cb( sm_t sm, sm_hook_fn cb )
+/**
+ * Return trace time stamp (cycle counter, or nanoseconds).
+ *
+ * @return Time.
+ */
+static inline uint64_t sm_trace_time( void )
 {
-    sm->get_cb = cb;
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
 }
 
-void sm_set_put_cb( sm_t sm, sm_hook_fn cb )
+
+/**
+ * Add event to trace buffer, and write the buffer if it is full. Slot
+ * address is stored to seg/index fields as is.
+ *
+ * @param sm   Segman.
+ * @param type Event type.
+ * @param slot Slot.
+ *
+ * @return NA
+ */
+static st_none sm_trace_add( sm_t sm, st_size_t type, st_t slot )
 {
-    sm->put_cb = cb;
+    sm_trace_t    trc;
+    sm_trace_ev_t ev;
+    uint64_t      addr;
+
+    trc = sm->ext->trace;
+    ev = &trc->ev[ trc->cnt ];
+    addr = (uintptr_t)slot;
+
+    ev->stamp = ( ( sm_trace_time() - trc->start ) << 2 ) | type;
+    ev->seg = addr >> 32;
+    ev->index = (uint32_t)addr;
+
+    if ( ++trc->cnt == trc->size ) {
+        sm_trace_write( sm );
+    }
 }
 
 #endif
 
 
+#ifdef SEGMAN_USE_PROFILE
+
+/**
+ * Count get to sampling interval, and sample the get when interval
+ * is reached. Caller frames are captured, hence this is never
+ * inlined. Segman frames are skipped up to the frame of "caller",
+ * since with LTO the number of Segman frames is not known.
+ *
+ * @param sm     Segman.
+ * @param slot   Slot from get.
+ * @param caller Return address of user get call.
+ *
+ * @return NA
+ */
+static st_none sm_prof_get( sm_t sm, st_t slot, void* caller )
+{
+    sm_prof_t prof;
+    void*     pc[ SM_PROFILE_DEPTH + 4 ];
+    int       depth;
+    int       skip;
+
+    prof = sm->ext->prof;
+
+    prof->countdown -= prof->step;
+    if ( prof->countdown > 0 ) {
+        return;
+    }
+
+    sm_prof_next( prof );
+
+    depth = backtrace( pc, SM_PROFILE_DEPTH + 4 );
+
+    skip = 1;
+    while ( skip < depth && pc[ skip ] != caller ) {
+        skip++;
+    }
+
+    if ( skip >= depth ) {
+        /* Caller not found, skip only sm_prof_get(). */
+        skip = depth < 1 ? depth : 1;
+    }
+
+    if ( depth - skip > SM_PROFILE_DEPTH ) {
+        depth = skip + SM_PROFILE_DEPTH;
+    }
+
+    sm_prof_insert( prof, slot, sm_prof_site( prof, pc + skip, depth - skip ) );
+}
 
-/* ------------------------------------------------------------
- * Internal functions:
- * ------------------------------------------------------------ */
 
 /**
- * Return size of block in terms of the unit.
+ * Remove slot from samples, if sampled.
  *
- * @param block_size Block size;
- * @param unit_size  Unit size.
+ * @param prof Profiler.
+ * @param slot Slot.
  *
- * @return Block size in units.
+ * @return NA
  */
-static st_size_t sm_size_in_units( st_size_t block_size, st_size_t unit_size )
+static st_none sm_prof_put( sm_prof_t prof, st_t slot )
 {
-    st_size_t odd;
-    st_size_t slots;
+    sm_sample_t tab;
+    st_size_t   mask;
+    st_size_t   i;
+    st_size_t   j;
+    st_size_t   k;
+
+    tab = prof->sample;
+    mask = prof->sample_size - 1;
+
+    for ( i = SM_SLOT_HASH( slot ) & mask; tab[ i ].slot != slot; i = ( i + 1 ) & mask ) {
+        if ( tab[ i ].slot == NULL ) {
+            return;
+        }
+    }
 
-    slots = ( block_size / unit_size );
-    odd = ( ( block_size % unit_size ) != 0 );
+    tab[ i ].site->live--;
+    prof->sample_cnt--;
 
-    return slots + odd;
+    /* Shift following entries back, so that probing needs no tombstones. */
+    for ( j = ( i + 1 ) & mask; tab[ j ].slot; j = ( j + 1 ) & mask ) {
+        k = SM_SLOT_HASH( tab[ j ].slot ) & mask;
+        if ( ( ( j - k ) & mask ) >= ( ( j - i ) & mask ) ) {
+            tab[ i ] = tab[ j ];
+            i = j;
+        }
+    }
+
+    tab[ i ].slot = NULL;
 }
 
 
 /**
- * Return host segment info.
+ * Set countdown to next sample. Interval is randomized to 50%-150% of
+ * mean, so that periodic get patterns are not aliased.
  *
- * @param slot_cnt   Slot count.
- * @param block_size Block size;
- * @param slot_size  Slot size.
+ * @param prof Profiler.
  *
- * @return Segment info.
+ * @return NA
  */
-static sm_info_s sm_host_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size )
+static st_none sm_prof_next( sm_prof_t prof )
 {
-    sm_info_s info;
+    /* xorshift64 */
+    prof->seed ^= prof->seed << 13;
+    prof->seed ^= prof->seed >> 7;
+    prof->seed ^= prof->seed << 17;
+
+    prof->countdown = prof->interval / 2 + prof->seed % ( prof->interval + 1 );
+    if ( prof->countdown <= 0 ) {
+        prof->countdown = 1;
+    }
+}
 
-    if ( block_size == 0 ) {
 
-        info.header_size = sizeof( sm_s );
-        info.slot_area = ( slot_cnt * slot_size );
+/**
+ * Find (or add) call site of stack.
+ *
+ * @param prof  Profiler.
+ * @param pc    Return addresses.
+ * @param depth Stack depth.
+ *
+ * @return Site.
+ */
+static sm_site_t sm_prof_site( sm_prof_t prof, void** pc, st_size_t depth )
+{
+    sm_site_t site;
+    uint64_t  hash;
+    st_size_t i;
+    st_size_t n;
+
+    hash = 0xcbf29ce484222325ULL;
+    for ( i = 0; i < depth; i++ ) {
+        hash = ( hash ^ (uintptr_t)pc[ i ] ) * 0x100000001b3ULL;
+    }
+    if ( hash == 0 ) {
+        hash = 1;
+    }
 
-    } else {
+    for ( n = 0, i = hash % SM_PROFILE_SITE_CNT; n < SM_PROFILE_SITE_CNT;
+          n++, i = ( i + 1 ) % SM_PROFILE_SITE_CNT ) {
 
-        st_size_t header_slots;
-        st_size_t slot_cnt;
+        site = &prof->site[ i ];
 
-        header_slots = sm_size_in_units( sizeof( sm_s ), slot_size );
-        info.header_size = ( header_slots * slot_size );
-        slot_cnt = ( block_size - info.header_size ) / slot_size;
-        info.slot_area = slot_cnt * slot_size;
+        if ( site->hash == 0 ) {
+            site->hash = hash;
+            site->depth = depth;
+            memcpy( site->pc, pc, depth * sizeof( void* ) );
+            return site;
+        }
+
+        if ( site->hash == hash && site->depth == depth
+             && !memcmp( site->pc, pc, depth * sizeof( void* ) ) ) {
+            return site;
+        }
     }
 
-    return info;
+    return &prof->other;
 }
 
 
 /**
- * Return tail segment info.
+ * Add sample of slot. Sample table is doubled when half full. Slot
+ * that is sampled already (put without sm_put()) is re-attributed.
  *
- * @param slot_cnt   Slot count.
- * @param block_size Block size;
- * @param slot_size  Slot size.
+ * @param prof Profiler.
+ * @param slot Slot.
+ * @param site Call site.
  *
- * @return Segment info.
+ * @return 1 on success (0 on failure).
  */
-static sm_info_s sm_tail_info( st_size_t slot_cnt, st_size_t block_size, st_size_t slot_size )
+static st_size_t sm_prof_insert( sm_prof_t prof, st_t slot, sm_site_t site )
 {
-    sm_info_s info;
+    sm_sample_t tab;
+    sm_sample_t old;
+    st_size_t   old_size;
+    st_size_t   mask;
+    st_size_t   i;
+    st_size_t   j;
+
+    if ( 2 * ( prof->sample_cnt + 1 ) > prof->sample_size ) {
+
+        old = prof->sample;
+        old_size = prof->sample_size;
+
+        prof->sample_size = old_size ? 2 * old_size : 64;
+        tab = st_alloc( prof->sample_size * sizeof( sm_sample_s ) );
+        if ( tab == NULL ) {
+            prof->sample_size = old_size;
+            return 0;
+        }
+        memset( tab, 0, prof->sample_size * sizeof( sm_sample_s ) );
+
+        mask = prof->sample_size - 1;
+        for ( j = 0; j < old_size; j++ ) {
+            if ( old[ j ].slot ) {
+                for ( i = SM_SLOT_HASH( old[ j ].slot ) & mask; tab[ i ].slot; i = ( i + 1 ) & mask ) {
+                }
+                tab[ i ] = old[ j ];
+            }
+        }
 
-    if ( block_size == 0 ) {
+        if ( old ) {
+            st_del( old );
+        }
+        prof->sample = tab;
+    }
 
-        info.header_size = sizeof( sm_tail_s );
-        info.slot_area = ( slot_cnt * slot_size );
+    tab = prof->sample;
+    mask = prof->sample_size - 1;
 
-    } else {
+    for ( i = SM_SLOT_HASH( slot ) & mask; tab[ i ].slot; i = ( i + 1 ) & mask ) {
+        if ( tab[ i ].slot == slot ) {
+            tab[ i ].site->live--;
+            prof->sample_cnt--;
+            break;
+        }
+    }
 
-        st_size_t header_slots;
-        st_size_t slot_cnt;
+    tab[ i ].slot = slot;
+    tab[ i ].site = site;
+    prof->sample_cnt++;
+    site->live++;
+    site->total++;
 
-        header_slots = sm_size_in_units( sizeof( sm_tail_s ), slot_size );
-        info.header_size = ( header_slots * slot_size );
-        slot_cnt = ( block_size - info.header_size ) / slot_size;
-        info.slot_area = slot_cnt * slot_size;
+    return 1;
+}
+
+
+/**
+ * Drop all samples, since all slots are free.
+ *
+ * @param prof Profiler.
+ *
+ * @return NA
+ */
+static st_none sm_prof_clear( sm_prof_t prof )
+{
+    st_size_t i;
+
+    if ( prof->sample ) {
+        memset( prof->sample, 0, prof->sample_size * sizeof( sm_sample_s ) );
     }
+    prof->sample_cnt = 0;
 
-    return info;
+    for ( i = 0; i < SM_PROFILE_SITE_CNT; i++ ) {
+        prof->site[ i ].live = 0;
+    }
+    prof->other.live = 0;
 }
 
 
 /**
- * Prepare the next slot that requires a link.
+ * Order sites by live samples, most first.
+ */
+static int sm_site_cmp( const void* a, const void* b )
+{
+    sm_site_t sa;
+    sm_site_t sb;
+
+    sa = *( (sm_site_t*)a );
+    sb = *( (sm_site_t*)b );
+
+    if ( sa->live != sb->live ) {
+        return sa->live < sb->live ? 1 : -1;
+    }
+
+    return 0;
+}
+
+#endif
+
+
+/**
+ * Number new Segments of Segman for trace. Segments are only added to
+ * the end of chain, hence new Segments follow the traced ones.
  *
  * @param sm Segman.
  *
+ * @return 1 on success (0 on allocation failure).
+ */
+static st_size_t sm_trace_seg_add( sm_t sm )
+{
+    sm_trace_t     trc;
+    sm_trace_seg_t seg;
+    sm_tail_t      cur;
+    st_size_t      cnt;
+    st_size_t      i;
+
+    trc = sm->ext->trace;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt++;
+    }
+
+    if ( cnt > trc->seg_size ) {
+        seg = st_alloc( cnt * 2 * sizeof( sm_trace_seg_s ) );
+        if ( seg == NULL ) {
+            return 0;
+        }
+        if ( trc->seg ) {
+            memcpy( seg, trc->seg, trc->seg_cnt * sizeof( sm_trace_seg_s ) );
+            st_del( trc->seg );
+        }
+        trc->seg = seg;
+        trc->seg_size = cnt * 2;
+    }
+
+    for ( cur = &sm->host, i = 0; cur; cur = cur->next, i++ ) {
+        if ( i >= trc->seg_cnt ) {
+            trc->seg[ i ].seg = cur;
+            trc->seg[ i ].id = trc->seg_next++;
+        }
+    }
+    trc->seg_cnt = cnt;
+
+    return 1;
+}
+
+
+/**
+ * Drop Segment from traced Segments, when it is released.
+ *
+ * @param trc Trace.
+ * @param seg Segment.
+ *
  * @return NA
  */
-static st_none sm_prepare_slot( sm_t sm )
+static st_none sm_trace_seg_rem( sm_trace_t trc, sm_tail_t seg )
 {
-    /* Make sure that each slot has a link before it is allocated. */
-    st_t slot;
-    slot = sm->tail->base + ( sm->tail->init_cnt * sm->slot_size );
+    st_size_t i;
+
+    for ( i = 0; i < trc->seg_cnt; i++ ) {
+        if ( trc->seg[ i ].seg == seg ) {
+            memmove( &trc->seg[ i ],
+                     &trc->seg[ i + 1 ],
+                     ( trc->seg_cnt - i - 1 ) * sizeof( sm_trace_seg_s ) );
+            trc->seg_cnt--;
+            return;
+        }
+    }
+}
 
-    /* Make Slot N content to point to Slot N+1. */
-    *( (st_p)slot ) = slot + sm->slot_size;
 
-    sm->tail->init_cnt++;
+/**
+ * Delete trace state.
+ *
+ * @param trc Trace.
+ *
+ * @return NA
+ */
+static st_none sm_trace_del( sm_trace_t trc )
+{
+    if ( trc->seg ) {
+        st_del( trc->seg );
+    }
+    st_del( trc );
 }
 
 
 /**
- * Allocate new Segman Segment.
+ * Translate buffered slot addresses to Segment number and slot index,
+ * and write the events as one chunk to trace file. Buffer is emptied
+ * also on failure.
  *
- * @param sm       Segman.
- * @param slot_cnt Slot count.
+ * @param sm Segman.
  *
+ * @return 1 on success (0 on failure).
  */
-static st_none sm_new_seg( sm_t sm )
+static st_size_t sm_trace_write( sm_t sm )
 {
-    st_size_t slot_cnt;
-    sm_tail_t new_seg;
+    sm_trace_t     trc;
+    sm_trace_hdr_s hdr;
+    sm_seg_ref_t   ref;
+    sm_seg_ref_t   r;
+    st_size_t      ref_cnt;
+    st_size_t      i;
+    uintptr_t      addr;
+    st_size_t      ret;
+
+    trc = sm->ext->trace;
+
+    if ( trc->cnt == 0 ) {
+        return 1;
+    }
 
-    sm_info_s info;
-    info = sm_tail_info( sm->slot_cnt, sm->block_size, sm->slot_size );
+    ref = sm_seg_refs( sm, NULL, &ref_cnt );
+    if ( ref == NULL || !sm_trace_seg_add( sm ) ) {
+        if ( ref ) {
+            st_del( ref );
+        }
+        trc->cnt = 0;
+        return 0;
+    }
 
-    if ( sm->block_size == 0 ) {
-        slot_cnt = ( sm->resize * sm->slot_cnt ) / 100;
-        new_seg = st_alloc( info.header_size + ( slot_cnt * sm->slot_size ) );
-        new_seg->base = (st_t)new_seg + info.header_size;
+    for ( i = 0; i < trc->cnt; i++ ) {
+
+        addr = ( (uint64_t)trc->ev[ i ].seg << 32 ) | trc->ev[ i ].index;
+        r = sm_seg_find( ref, ref_cnt, addr );
+
+        if ( r ) {
+            /* Segment order matches the traced Segments. */
+            trc->ev[ i ].seg = trc->seg[ r->num ].id;
+            trc->ev[ i ].index = ( addr - r->base ) / sm->slot_size;
+        } else {
+            trc->ev[ i ].seg = UINT32_MAX;
+            trc->ev[ i ].index = UINT32_MAX;
+        }
+    }
+
+    st_del( ref );
+
+    hdr.magic = SM_TRACE_MAGIC;
+    hdr.ev_cnt = trc->cnt;
+    hdr.slot_size = sm->slot_size;
+#if defined( __x86_64__ ) || defined( __i386__ )
+    hdr.clock = SM_TRACE_CLOCK_TSC;
+#else
+    hdr.clock = SM_TRACE_CLOCK_NS;
+#endif
+
+    ret = sm_write( trc->fd, &hdr, sizeof( hdr ) )
+          && sm_write( trc->fd, trc->ev, trc->cnt * sizeof( sm_trace_ev_s ) );
+
+    trc->cnt = 0;
+
+    return ret;
+}
+
+
+/**
+ * Create Segment address table, sorted by base address. Table covers
+ * Segments from host to "last", or all Segments.
+ *
+ * @param sm   Segman.
+ * @param last Last Segment (or NULL for all).
+ * @param cnt  Number of table entries.
+ *
+ * @return Table (or NULL if allocation failed).
+ */
+static sm_seg_ref_t sm_seg_refs( sm_t sm, sm_tail_t last, st_size_t* cnt )
+{
+    sm_seg_ref_t ref;
+    sm_tail_t    cur;
+    st_size_t    bit;
+    st_size_t    i;
+
+    *cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        ( *cnt )++;
+        if ( cur == last ) {
+            break;
+        }
+    }
+
+    ref = st_alloc( *cnt * sizeof( sm_seg_ref_s ) );
+    if ( ref == NULL ) {
+        return NULL;
+    }
+
+    cur = &sm->host;
+    bit = 0;
+    for ( i = 0; i < *cnt; i++ ) {
+        ref[ i ].base = (uintptr_t)cur->base;
+        ref[ i ].end = (uintptr_t)cur->base + cur->tail_cnt * sm->slot_size;
+        ref[ i ].num = i;
+        ref[ i ].seg = cur;
+        ref[ i ].bit = bit;
+        bit += cur->tail_cnt;
+        cur = cur->next;
+    }
+
+    qsort( ref, *cnt, sizeof( sm_seg_ref_s ), sm_seg_ref_cmp );
+
+    return ref;
+}
+
+
+/**
+ * Find Segment of slot address.
+ *
+ * @param ref  Segment address table.
+ * @param cnt  Number of table entries.
+ * @param addr Slot address.
+ *
+ * @return Table entry (or NULL if not found).
+ */
+static sm_seg_ref_t sm_seg_find( sm_seg_ref_t ref, st_size_t cnt, uintptr_t addr )
+{
+    st_size_t lo;
+    st_size_t hi;
+    st_size_t mid;
+
+    /* Last Segment starting at or before the address. */
+    lo = 0;
+    hi = cnt;
+    while ( hi - lo > 1 ) {
+        mid = ( lo + hi ) / 2;
+        if ( ref[ mid ].base <= addr ) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if ( addr >= ref[ lo ].base && addr < ref[ lo ].end ) {
+        return &ref[ lo ];
     } else {
-        slot_cnt = info.slot_area / sm->slot_size;
-        new_seg = st_alloc( info.header_size + info.slot_area );
-        new_seg->base = (st_t)new_seg + info.header_size;
+        return NULL;
     }
+}
 
-    new_seg->tail_cnt = slot_cnt;
-    new_seg->init_cnt = 0;
-    new_seg->next = NULL;
 
-    sm->tail->next = new_seg;
+/**
+ * Compare Segment references by base address.
+ *
+ * @param a Reference.
+ * @param b Reference.
+ *
+ * @return qsort() order.
+ */
+static int sm_seg_ref_cmp( const void* a, const void* b )
+{
+    uintptr_t x;
+    uintptr_t y;
+
+    x = ( (const sm_seg_ref_s*)a )->base;
+    y = ( (const sm_seg_ref_s*)b )->base;
+
+    return ( x > y ) - ( x < y );
+}
+
+
+/**
+ * Write all of buffer to file.
+ *
+ * @param fd   File descriptor.
+ * @param buf  Data.
+ * @param size Data size.
+ *
+ * @return 1 on success (0 on failure).
+ */
+static st_size_t sm_write( int fd, const void* buf, st_size_t size )
+{
+    const char* p;
+    ssize_t     ret;
+
+    p = buf;
+    while ( size > 0 ) {
+        ret = write( fd, p, size );
+        if ( ret <= 0 ) {
+            return 0;
+        }
+        p += ret;
+        size -= ret;
+    }
 
-    sm->head = new_seg->base;
-    sm->tail = new_seg;
-    sm->free_cnt += slot_cnt;
+    return 1;
 }
 
 
@@ -497,6 +5250,8 @@ static st_none sm_init_host( sm_t      sm,
     sm->tail = &( sm->host );
 
     sm->resize = 100;
+    sm->flags = 0;
+    sm->ext = NULL;
 
     sm->tail->base = sm->head;
     sm->tail->tail_cnt = slot_cnt;
@@ -507,4 +5262,8 @@ static st_none sm_init_host( sm_t      sm,
     sm->get_cb = NULL;
     sm->put_cb = NULL;
 #endif
+
+    if ( __atomic_load_n( &sm_reg_on, __ATOMIC_RELAXED ) ) {
+        sm_reg_add( sm );
+    }
 }
@@ -12,17 +12,137 @@
  */
 
 #include <sixten.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #ifndef SM_MIN_SLOT_CNT
 #define SM_MIN_SLOT_CNT 4
 #endif
 
+#ifndef SM_RUN_MAX
+#define SM_RUN_MAX 64
+#endif
+
+#ifndef SM_READER_MAX
+#define SM_READER_MAX 64
+#endif
+
+#ifndef SM_DEFER_BATCH_CNT
+#define SM_DEFER_BATCH_CNT 64
+#endif
+
+#ifndef SM_NAME_MAX
+#define SM_NAME_MAX 32
+#endif
+
+#ifndef SM_CPU_CACHE_CNT
+#define SM_CPU_CACHE_CNT 64
+#endif
+
+#ifndef SM_CPU_BATCH_CNT
+#define SM_CPU_BATCH_CNT 32
+#endif
+
+#ifndef SM_ZERO_BATCH_CNT
+#define SM_ZERO_BATCH_CNT 64
+#endif
+
+#ifndef SM_PROFILE_DEPTH
+#define SM_PROFILE_DEPTH 8
+#endif
+
+#ifndef SM_PROFILE_SITE_CNT
+#define SM_PROFILE_SITE_CNT 256
+#endif
+
+#ifndef SM_CACHE_LINE
+#define SM_CACHE_LINE 64
+#endif
+
+
+/** Reservation flags for sm_reserve(). */
+#define SM_RESERVE_PREFAULT 0x1 /**< Touch all pages of reserved Segments. */
+#define SM_RESERVE_LOCK     0x2 /**< Lock reserved Segments to memory. */
+#define SM_RESERVE_FIXED    0x4 /**< Never allocate in sm_get() after this. */
+#define SM_RESERVE_SINGLE   0x8 /**< Reserve with one (larger) Segment. */
+
+/** Zeroed mode flags for sm_set_zeroed(). */
+#define SM_ZERO_IDLE 0x1 /**< Clear free slots in sm_idle(). */
+
+/** Infinite timeout for sm_get_wait(). */
+#define SM_WAIT_INF ( (st_size_t)-1 )
+
+/** Profiling flags for sm_profile_start(). */
+#define SM_PROFILE_BYTES 0x1 /**< Sampling interval is in bytes (not gets). */
+
+/** Registry dump formats. */
+#define SM_DUMP_TEXT 0 /**< Prometheus text format. */
+#define SM_DUMP_JSON 1 /**< JSON format. */
+
+/** Segman mode flags. */
+#define SM_FLAG_FIXED   0x01 /**< Segment allocation disabled for sm_get(). */
+#define SM_FLAG_LOCKED  0x02 /**< Segments have been locked to memory. */
+#define SM_FLAG_LOWAT   0x04 /**< Low-water mark provisioning active. */
+#define SM_FLAG_OBJECT  0x08 /**< Object mode (see sm_set_object()). */
+#define SM_FLAG_TRACE   0x10 /**< Trace recording (see sm_trace_start()). */
+#define SM_FLAG_ZERO    0x20 /**< Zeroed mode (see sm_set_zeroed()). */
+#define SM_FLAG_PROFILE 0x40 /**< Sampling profiler (see sm_profile_start()). */
+
+/** Trace event types. */
+#define SM_TRACE_GET  1 /**< Slot allocated. */
+#define SM_TRACE_PUT  2 /**< Slot released. */
+#define SM_TRACE_GROW 3 /**< Segment added (slot is Segment base). */
+
+/** Trace file chunk magic ("SMTR"). */
+#define SM_TRACE_MAGIC 0x52544d53
+
+/* Trace time units. */
+#define SM_TRACE_CLOCK_NS  0 /**< Nanoseconds. */
+#define SM_TRACE_CLOCK_TSC 1 /**< CPU timestamp counter ticks. */
+
+/** Trace event type and time from event stamp. */
+#define SM_TRACE_TYPE( ev ) ( ( ev )->stamp & 0x3 )
+#define SM_TRACE_TIME( ev ) ( ( ev )->stamp >> 2 )
+
 
 st_struct_type( sm );
 st_struct_type( sm_tail );
+st_struct_type( sm_ext );
+st_struct_type( sm_run );
+st_struct_type( sm_ebr );
+st_struct_type( sm_bag );
+st_struct_type( sm_cpu );
+st_struct_type( sm_xlat );
+st_struct_type( sm_budget );
 
 
 typedef void ( *sm_hook_fn )( sm_t sm, st_t slot );
+typedef void ( *sm_obj_fn )( sm_t sm, st_t slot );
+
+
+/**
+ * Trace file chunk header. Trace file is a sequence of chunks, and
+ * each chunk is a header followed by "ev_cnt" events.
+ */
+st_struct( sm_trace_hdr )
+{
+    uint32_t magic;     /**< SM_TRACE_MAGIC. */
+    uint32_t ev_cnt;    /**< Number of events in chunk. */
+    uint64_t slot_size; /**< Slot size of traced Segman. */
+    uint64_t clock;     /**< Time unit (SM_TRACE_CLOCK_*). */
+};
+
+/**
+ * Trace file event. Slot is identified by Segment number and slot
+ * index within the Segment. Segments are numbered in allocation order
+ * (0 for host) and numbers are not reused after trim.
+ */
+st_struct( sm_trace_ev )
+{
+    uint64_t stamp; /**< Time (ticks from start) and event type. */
+    uint32_t seg;   /**< Segment number (UINT32_MAX if not resolved). */
+    uint32_t index; /**< Slot index. */
+};
 
 
 /** Segman Tail structure. */
@@ -48,6 +168,8 @@ st_struct_body( sm )
     sm_tail_s host; /**< Segment spec. */
 
     st_size_t resize; /**< Resize factor percentage. */
+    st_size_t flags;  /**< Mode flags (SM_FLAG_*). */
+    sm_ext_t  ext;    /**< Extension state (NULL if not used). */
 
 #ifdef SEGMAN_USE_HOOKS
     sm_hook_fn get_cb; /**< Callback for get. */
@@ -62,7 +184,7 @@ st_struct_body( sm )
  * @param slot_cnt  Number of memory slots.
  * @param slot_size Memory slot size.
  *
- * @return Segman.
+ * @return Segman (or NULL on allocation failure).
  */
 sm_t sm_new( st_size_t slot_cnt, st_size_t slot_size );
 
@@ -73,7 +195,7 @@ sm_t sm_new( st_size_t slot_cnt, st_size_t slot_size );
  * @param block_size  Segment block size.
  * @param slot_size   Memory slot size.
  *
- * @return Segman.
+ * @return Segman (or NULL on allocation failure).
  */
 sm_t sm_new_block( st_size_t block_size, st_size_t slot_size );
 
@@ -106,6 +228,10 @@ sm_t sm_use_block( st_t mem, st_size_t block_size, st_size_t slot_size );
 /**
  * Free all slots, but leave Segman allocations.
  *
+ * Only Host is reset immediately, and Tail Segments are reset when
+ * sm_get() reaches them. Hence reset does not depend on the number of
+ * Segments.
+ *
  * @param sm Segman.
  *
  * @return NULL.
@@ -124,7 +250,7 @@ sm_t sm_del( sm_t sm );
 
 
 /**
- * Destroy memory Segman tail.
+ * Destroy memory Segman tail and extension state.
  *
  * @param sm Segman.
  *
@@ -133,6 +259,84 @@ sm_t sm_del( sm_t sm );
 sm_t sm_del_tail( sm_t sm );
 
 
+/**
+ * Create a copy of Segman, including the content of slots. Segments
+ * are copied as whole, and the free list is rebased to the copy. The
+ * copy has the same layout, hence slot pointers stored in slots can
+ * be translated with sm_xlat().
+ *
+ * Segman with runs, pending deferred slots, decommitted slots,
+ * cleared free slots or stolen slots is not cloned. In object mode, slots are copied
+ * in constructed state (without constructor calls). Provisioning,
+ * trace, profiler and name are not copied.
+ *
+ * @param sm   Segman.
+ * @param xlat Address translation (output, or NULL if not needed).
+ *
+ * @return Copy of Segman (or NULL on failure).
+ */
+sm_t sm_clone( sm_t sm, sm_xlat_t* xlat );
+
+
+/**
+ * Translate slot address of original Segman to the clone. Addresses
+ * outside the original slots are returned as is.
+ *
+ * @param xlat Address translation from sm_clone().
+ * @param ptr  Address.
+ *
+ * @return Translated address.
+ */
+st_t sm_xlat( sm_xlat_t xlat, st_t ptr );
+
+
+/**
+ * Destroy address translation.
+ *
+ * @param xlat Address translation.
+ *
+ * @return NULL.
+ */
+sm_xlat_t sm_xlat_del( sm_xlat_t xlat );
+
+
+/**
+ * Move "n" free slots from "src" to "dst" with one splice. The slots
+ * are taken from the head of source free list, and only slots that
+ * have been linked are moved.
+ *
+ * Moved slots remain in the memory of "src", hence "src" must not be
+ * reset or deleted while "dst" is using them. Slot size (and object
+ * mode link offset) must match.
+ *
+ * "dst" counts the stolen slots until it is reset. Meanwhile, "dst"
+ * is not cloned or decommitted.
+ *
+ * @param dst Destination Segman.
+ * @param src Source Segman.
+ * @param n   Number of slots.
+ *
+ * @return Number of moved slots.
+ */
+st_size_t sm_steal( sm_t dst, sm_t src, st_size_t n );
+
+
+/**
+ * Move Tail Segments of "src" to the end of the Segment chain of
+ * "dst", without copying. The Segments are taken into use by dst,
+ * when its earlier Segments are used. "src" is left with Host only.
+ *
+ * Source must not have used slots or runs. Slot size, Block size,
+ * object mode and zeroed mode must match.
+ *
+ * @param dst Destination Segman.
+ * @param src Source Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_merge( sm_t dst, sm_t src );
+
+
 /**
  * Set Segman resize factor percentage. 0 (the default) means no
  * automatic resizing at out-of-mem condition. Typically factor of
@@ -149,6 +353,126 @@ sm_t sm_del_tail( sm_t sm );
 st_size_t sm_set_resize_factor( sm_t sm, st_size_t factor );
 
 
+/**
+ * Reserve Segments in advance so that at least "n_slots" slots can
+ * be allocated without Segment allocation in sm_get().
+ *
+ * New Segments are appended after the existing ones and they are
+ * taken into use by sm_get() gradually, as after sm_reset(). If
+ * resize factor is 0, Segments are sized as with factor of 100%.
+ *
+ * With SM_RESERVE_PREFAULT, all pages of the current and the
+ * following Segments are touched. With SM_RESERVE_LOCK, the same
+ * Segments are locked to memory (and unlocked at delete). With
+ * SM_RESERVE_FIXED, sm_get() will never allocate Segments, but
+ * returns NULL when the reservation is exhausted. With
+ * SM_RESERVE_SINGLE, the missing slots are reserved with one Segment,
+ * which is larger than resize factor gives, if needed (not in Block
+ * mode).
+ *
+ * @param sm      Segman.
+ * @param n_slots Number of slots to have available.
+ * @param flags   Reservation flags (SM_RESERVE_*).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_reserve( sm_t sm, st_size_t n_slots, st_size_t flags );
+
+
+/**
+ * Set low-water mark for free slots. When free slots in the current
+ * Segment drop below the mark, sm_get() requests provisioning of the
+ * next Segment. Provisioning is performed by sm_maintain() or by the
+ * provisioning thread (see sm_provision_start()). sm_get() takes the
+ * provisioned Segment into use when it runs out of slots.
+ *
+ * If the provisioned Segment is not ready, sm_get() falls back to
+ * normal Segment allocation (unless disabled).
+ *
+ * @param sm    Segman.
+ * @param lowat Low-water mark (0 to disable).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_low_water( sm_t sm, st_size_t lowat );
+
+
+/**
+ * Perform requested provisioning, i.e. allocate and prefault the next
+ * Segment. Can be called from another thread than the Segman user.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on allocation failure).
+ */
+st_size_t sm_maintain( sm_t sm );
+
+
+/**
+ * Start provisioning thread, which calls sm_maintain() when
+ * provisioning is requested.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_provision_start( sm_t sm );
+
+
+/**
+ * Stop provisioning thread.
+ *
+ * @param sm Segman.
+ */
+st_none sm_provision_stop( sm_t sm );
+
+
+/**
+ * Release memory pages of Tail Segments, which contain only free
+ * slots, back to the system (with madvise()). Host Segment is not
+ * released, since its memory might be given by the user (see
+ * sm_use()). The free list is rebuilt, and released
+ * slots are linked again, a page at a time, when sm_get() runs out of
+ * other free slots. Released slots are still counted as free.
+ *
+ * Object mode and locked Segmans, and Segmans with stolen slots (see
+ * sm_steal()), are not decommitted.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_decommit( sm_t sm );
+
+
+/**
+ * Set idle time for automatic decommit. sm_idle() performs
+ * sm_decommit() after Segman has been idle for "idle_ms".
+ *
+ * @param sm      Segman.
+ * @param idle_ms Idle time in milliseconds (0 to disable).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_idle_decommit( sm_t sm, st_size_t idle_ms );
+
+
+/**
+ * Perform idle time work. Segman is considered idle, when no activity
+ * is seen between sm_idle() calls. sm_idle() should be called
+ * periodically by the Segman user, e.g. from an event loop timer.
+ *
+ * If Segman has more memory than its share of the budget (limit
+ * divided by the number of Segmans), and free slots for at least one
+ * Tail Segment, unused Segments are released with sm_trim().
+ *
+ * @param sm Segman.
+ *
+ * @return 1 if work was performed (0 otherwise).
+ */
+st_size_t sm_idle( sm_t sm );
+
+
 /**
  * Return Head Segment allocation size (non Block).
  *
@@ -222,6 +546,16 @@ st_size_t sm_used_count( sm_t sm );
 st_size_t sm_free_count( sm_t sm );
 
 
+/**
+ * Return number of slots in provisioned, but unused Segment.
+ *
+ * @param sm Segman.
+ *
+ * @return Count.
+ */
+st_size_t sm_spare_count( sm_t sm );
+
+
 /**
  * Return Host Segment struct size in bytes.
  *
@@ -259,6 +593,194 @@ st_t sm_get( sm_t sm );
 sm_t sm_put( sm_t sm, st_t slot );
 
 
+/**
+ * Allocate (get) a slot of memory, and wait for a slot to be released
+ * if pool is exhausted (e.g. with resize factor 0).
+ *
+ * Segman is shared by threads under "lock", which the caller holds
+ * also when calling sm_get_wait(). The lock is released while
+ * waiting, as with pthread_cond_wait(). A waiter is woken only when
+ * the pool becomes non-empty, by sm_put(), sm_reclaim(), sm_reset(),
+ * sm_reserve(), sm_steal() or sm_merge().
+ *
+ * @param sm         Segman.
+ * @param timeout_ms Timeout in milliseconds (or SM_WAIT_INF).
+ * @param lock       Segman lock (NULL for no waiting).
+ *
+ * @return Memory slot (or NULL at timeout).
+ */
+st_t sm_get_wait( sm_t sm, st_size_t timeout_ms, pthread_mutex_t* lock );
+
+
+/**
+ * Return readiness eventfd of Segman. The eventfd becomes readable,
+ * when an exhausted pool becomes non-empty (see sm_get_wait()). The
+ * eventfd can be waited with poll, epoll or io_uring. After reading
+ * the eventfd, the waiter should get slots until sm_get() returns
+ * NULL, since the next notification comes only after the pool is
+ * exhausted again.
+ *
+ * The eventfd is non-blocking, and it is closed when Segman is
+ * deleted.
+ *
+ * @param sm Segman.
+ *
+ * @return File descriptor (or -1 on failure).
+ */
+int sm_wait_fd( sm_t sm );
+
+
+/**
+ * Allocate (get) a slot of memory, which is cleared to zero.
+ *
+ * In zeroed mode (see sm_set_zeroed()), slots that have not been used
+ * since Segment allocation, and slots cleared by sm_idle(), are
+ * returned without clearing.
+ *
+ * @param sm Segman.
+ *
+ * @return Memory slot (or NULL if memory pool is exhausted).
+ */
+st_t sm_get_zeroed( sm_t sm );
+
+
+/**
+ * Set zeroed mode, where sm_get_zeroed() tracks the slots that are
+ * known to be zero. Tail Segments are cleared once at allocation, and
+ * their slots are not cleared again before the first use. With
+ * SM_ZERO_IDLE, sm_idle() clears free slots in batches.
+ *
+ * Zeroed mode must be set before tail Segments are allocated, and it
+ * can't be combined with object mode.
+ *
+ * @param sm    Segman.
+ * @param flags Zeroed mode flags (SM_ZERO_*).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_zeroed( sm_t sm, st_size_t flags );
+
+
+/**
+ * Allocate (get) "n" contiguous slots.
+ *
+ * Runs are allocated from run Segments, which have the same size as
+ * Tail Segments, but they are managed with an allocation bitmap
+ * instead of the free list. Runs are not counted in the slot counts
+ * of Segman, and they are not available in object mode.
+ *
+ * @param sm Segman.
+ * @param n  Number of slots (max SM_RUN_MAX).
+ *
+ * @return First slot of run (or NULL if not available).
+ */
+st_t sm_get_run( sm_t sm, st_size_t n );
+
+
+/**
+ * De-allocate (put back) run of "n" slots. Slots must be allocated
+ * (put fails otherwise).
+ *
+ * @param sm   Segman.
+ * @param slot First slot of run.
+ * @param n    Number of slots.
+ *
+ * @return Pool on success (NULL otherwise).
+ */
+sm_t sm_put_run( sm_t sm, st_t slot, st_size_t n );
+
+
+/**
+ * Enable deferred reclamation. Must be called before readers use
+ * sm_read_enter().
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_deferred( sm_t sm );
+
+
+/**
+ * De-allocate slot, when no reader can access it anymore.
+ *
+ * Slots are collected per epoch, without touching the slot content.
+ * Epoch is advanced when all active readers have entered the current
+ * epoch, and slots of the epoch before the previous one are put to
+ * the free list as one batch.
+ * Reclamation is attempted every SM_DEFER_BATCH_CNT deferred slots,
+ * when Segman runs out of slots, and by sm_reclaim().
+ *
+ * Slot is counted as used until it is reclaimed.
+ *
+ * Deferred mode must be enabled with sm_set_deferred().
+ *
+ * @param sm   Segman.
+ * @param slot Slot to return to pool.
+ *
+ * @return Pool (or NULL if not in deferred mode, or on allocation
+ *         failure).
+ */
+sm_t sm_put_deferred( sm_t sm, st_t slot );
+
+
+/**
+ * Reclaim deferred slots, if possible.
+ *
+ * @param sm Segman.
+ *
+ * @return Number of reclaimed slots.
+ */
+st_size_t sm_reclaim( sm_t sm );
+
+
+/**
+ * Enter read-side section, where slots from Segman are accessed
+ * (from any thread). Slots that are deferred after entering are not
+ * reclaimed before exit.
+ *
+ * Deferred mode must be enabled with sm_set_deferred() (asserted).
+ *
+ * @param sm Segman.
+ *
+ * @return Token for sm_read_exit().
+ */
+st_size_t sm_read_enter( sm_t sm );
+
+
+/**
+ * Exit read-side section.
+ *
+ * Deferred mode must be enabled with sm_set_deferred() (asserted).
+ *
+ * @param sm    Segman.
+ * @param token Token from sm_read_enter().
+ */
+st_none sm_read_exit( sm_t sm, st_size_t token );
+
+
+/**
+ * Set object mode, where slots are kept in constructed state.
+ *
+ * Constructor is called once for each slot, when the slot is set up
+ * for the first time. Destructor is called for all constructed slots
+ * when the Segment is released. The free link is stored at "link_off"
+ * within the slot, and hence the rest of the slot content is
+ * preserved while the slot is free. sm_reset() preserves the
+ * constructed slots.
+ *
+ * Object mode must be set before any slot is allocated.
+ *
+ * @param sm       Segman.
+ * @param ctor     Slot constructor (or NULL).
+ * @param dtor     Slot destructor (or NULL).
+ * @param link_off Free link offset in slot (pointer aligned).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_object( sm_t sm, sm_obj_fn ctor, sm_obj_fn dtor, st_size_t link_off );
+
+
 /* ------------------------------------------------------------
  * SEGMAN_USE_HOOKS
  */
@@ -280,4 +802,256 @@ void sm_set_get_cb( sm_t sm, sm_hook_fn cb );
  */
 void sm_set_put_cb( sm_t sm, sm_hook_fn cb );
 
+
+
+/* ------------------------------------------------------------
+ * SEGMAN_USE_TRACE
+ */
+
+/**
+ * Start recording get/put/grow events of Segman. Events are collected
+ * to a buffer, and the buffer is written to "fd" when it becomes full,
+ * and at sm_trace_flush() and sm_trace_stop(). Slot addresses are
+ * translated to Segment number and slot index only at write. Buffer
+ * is also written before sm_trim() releases Segments.
+ *
+ * Recording is compiled in with SEGMAN_USE_TRACE.
+ *
+ * @param sm     Segman.
+ * @param ev_cnt Number of events in buffer.
+ * @param fd     Trace file descriptor.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_trace_start( sm_t sm, st_size_t ev_cnt, int fd );
+
+
+/**
+ * Write buffered trace events.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_trace_flush( sm_t sm );
+
+
+/**
+ * Write buffered trace events and stop recording.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_trace_stop( sm_t sm );
+
+
+
+/* ------------------------------------------------------------
+ * SEGMAN_USE_PROFILE
+ */
+
+/**
+ * Start sampling profiler. Roughly one in "interval" sm_get() calls
+ * (or one per "interval" bytes with SM_PROFILE_BYTES) is sampled. Call
+ * stack of sampled get is stored with the slot, until the slot is
+ * released with sm_put().
+ *
+ * Profiler is compiled in with SEGMAN_USE_PROFILE.
+ *
+ * @param sm       Segman.
+ * @param interval Mean sampling interval.
+ * @param flags    Profiling flags (SM_PROFILE_*).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_profile_start( sm_t sm, st_size_t interval, st_size_t flags );
+
+
+/**
+ * Stop sampling profiler and discard samples.
+ *
+ * @param sm Segman.
+ *
+ * @return 1 on success (0 if not profiling).
+ */
+st_size_t sm_profile_stop( sm_t sm );
+
+
+/**
+ * Write live slots and bytes per call site, estimated from the
+ * samples. Call sites are written in order of live bytes.
+ *
+ * @param sm Segman.
+ * @param fd File descriptor.
+ *
+ * @return 1 on success (0 if not profiling).
+ */
+st_size_t sm_profile_dump( sm_t sm, int fd );
+
+
+
+/* ------------------------------------------------------------
+ * Registry
+ */
+
+/**
+ * Enable (or disable) pool registry. When enabled, all created Segmans
+ * join the registry. Segman leaves the registry when it is deleted
+ * (with sm_del() or sm_del_tail()).
+ *
+ * @param enable 1 to enable (0 to disable).
+ */
+st_none sm_registry_enable( st_size_t enable );
+
+
+/**
+ * Set Segman name label. Segman joins registry, if registry is
+ * enabled.
+ *
+ * @param sm   Segman.
+ * @param name Name (truncated to SM_NAME_MAX-1 characters).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_name( sm_t sm, const char* name );
+
+
+/**
+ * Dump metrics of registered Segmans: slot size, total/used/free
+ * counts, Segment count, and allocated bytes.
+ *
+ * Counters are not synchronized with Segman users, hence the dump
+ * is a snapshot. Segment memory is not accessed, since it might be
+ * released meanwhile.
+ *
+ * @param fd     File descriptor.
+ * @param format SM_DUMP_TEXT or SM_DUMP_JSON.
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_registry_dump( int fd, st_size_t format );
+
+
+/* ------------------------------------------------------------
+ * Memory budget
+ */
+
+/**
+ * Create memory budget, which is shared by Segmans. Segment
+ * allocations of attached Segmans are charged to the budget, and
+ * growth beyond the limit is refused (sm_get() returns NULL).
+ *
+ * With "wait_ms", allocation waits up to "wait_ms" milliseconds for
+ * other Segmans to release memory, before it is refused.
+ *
+ * @param limit   Limit in bytes.
+ * @param wait_ms Wait time for release (0 for no waiting).
+ *
+ * @return Budget (or NULL on failure).
+ */
+sm_budget_t sm_budget_new( st_size_t limit, st_size_t wait_ms );
+
+
+/**
+ * Destroy memory budget. Segmans must be detached first.
+ *
+ * @param bg Budget.
+ *
+ * @return NULL.
+ */
+sm_budget_t sm_budget_del( sm_budget_t bg );
+
+
+/**
+ * Return bytes charged to budget.
+ *
+ * @param bg Budget.
+ *
+ * @return Charged bytes.
+ */
+st_size_t sm_budget_used( sm_budget_t bg );
+
+
+/**
+ * Attach Segman to budget (or detach with NULL). The existing memory
+ * of Segman is charged at attach, also when it exceeds the limit.
+ * Segman is detached when it is deleted.
+ *
+ * @param sm Segman.
+ * @param bg Budget (or NULL).
+ *
+ * @return 1 on success (0 on failure).
+ */
+st_size_t sm_set_budget( sm_t sm, sm_budget_t bg );
+
+
+/**
+ * Release unused Segments: Segments after the current tail (reserved
+ * or left from sm_reset()), the provisioned Segment, run Segments
+ * without runs, and Tail Segments that have only free slots. The free
+ * list of the remaining Segments is rebuilt. Segmans with
+ * SM_FLAG_FIXED are not trimmed.
+ *
+ * Tail Segments in use are kept, if Segman has stolen or decommitted
+ * slots.
+ *
+ * @param sm Segman.
+ *
+ * @return Number of released bytes.
+ */
+st_size_t sm_trim( sm_t sm );
+
+
+/* ------------------------------------------------------------
+ * Per-CPU front end
+ */
+
+/**
+ * Create per-CPU front end for Segman. Each CPU has a cache of free
+ * slots, which is used without locks or atomics (with rseq). Caches
+ * are refilled from (and drained to) Segman in batches, under a
+ * lock. All CPUs hence share the Segments of Segman.
+ *
+ * Segman must not be used directly while the front end exists.
+ * Cached slots are counted as used in Segman.
+ *
+ * @param sm        Segman.
+ * @param cache_cnt Number of cached slots per CPU (0 for default).
+ *
+ * @return Front end (or NULL on failure).
+ */
+sm_cpu_t sm_cpu_new( sm_t sm, st_size_t cache_cnt );
+
+
+/**
+ * Destroy per-CPU front end. Cached slots are returned to Segman.
+ *
+ * @param smc Front end.
+ *
+ * @return NULL.
+ */
+sm_cpu_t sm_cpu_del( sm_cpu_t smc );
+
+
+/**
+ * Allocate (get) a slot of memory through the current CPU cache.
+ *
+ * @param smc Front end.
+ *
+ * @return Memory slot (or NULL if memory pool is exhausted).
+ */
+st_t sm_cpu_get( sm_cpu_t smc );
+
+
+/**
+ * De-allocate (put back) a slot of memory to the current CPU cache.
+ *
+ * @param smc  Front end.
+ * @param slot Slot to return to pool.
+ *
+ * @return Front end.
+ */
+sm_cpu_t sm_cpu_put( sm_cpu_t smc, st_t slot );
+
 #endif
@@ -0,0 +1,388 @@
+/**
+ * @file   smcont.c
+ *
+ * @brief  Segman backed containers.
+ *
+ */
+
+#include <string.h>
+#include "smcont.h"
+
+
+/** Resize factor of node pools. */
+#define SMC_RESIZE 200
+
+
+static st_none smh_rehash( smh_t h, st_size_t bucket_cnt );
+
+
+
+/* ------------------------------------------------------------
+ * Hash map:
+ */
+
+smh_t smh_new( st_size_t node_size, st_size_t node_cnt, smh_hash_fn hash, smh_eq_fn eq )
+{
+    smh_t     h;
+    st_size_t bucket_cnt;
+
+    if ( node_size < sizeof( smh_node_s ) ) {
+        return NULL;
+    }
+
+    h = st_alloc( sizeof( smh_s ) );
+    if ( h == NULL ) {
+        return NULL;
+    }
+
+    bucket_cnt = SMH_MIN_BUCKET_CNT;
+    while ( bucket_cnt < node_cnt ) {
+        bucket_cnt *= 2;
+    }
+
+    h->bucket = st_alloc( bucket_cnt * sizeof( smh_node_t ) );
+    if ( h->bucket == NULL ) {
+        st_del( h );
+        return NULL;
+    }
+    memset( h->bucket, 0, bucket_cnt * sizeof( smh_node_t ) );
+
+    if ( node_cnt < SM_MIN_SLOT_CNT ) {
+        node_cnt = SM_MIN_SLOT_CNT;
+    }
+
+    h->sm = sm_new( node_cnt, node_size );
+    if ( h->sm == NULL ) {
+        st_del( h->bucket );
+        st_del( h );
+        return NULL;
+    }
+    sm_set_resize_factor( h->sm, SMC_RESIZE );
+
+    h->bucket_cnt = bucket_cnt;
+    h->cnt = 0;
+    h->hash = hash;
+    h->eq = eq;
+
+    return h;
+}
+
+
+smh_t smh_del( smh_t h )
+{
+    sm_del( h->sm );
+    st_del( h->bucket );
+    st_del( h );
+
+    return NULL;
+}
+
+
+st_none smh_clear( smh_t h )
+{
+    memset( h->bucket, 0, h->bucket_cnt * sizeof( smh_node_t ) );
+    sm_reset( h->sm );
+    h->cnt = 0;
+}
+
+
+st_t smh_node_get( smh_t h )
+{
+    return sm_get( h->sm );
+}
+
+
+st_none smh_node_put( smh_t h, st_t node )
+{
+    sm_put( h->sm, node );
+}
+
+
+st_size_t smh_insert( smh_t h, st_t node, st_t key )
+{
+    smh_node_t* bucket;
+    smh_node_t  cur;
+    st_size_t   hash;
+
+    hash = h->hash( key );
+    bucket = &h->bucket[ hash & ( h->bucket_cnt - 1 ) ];
+
+    for ( cur = *bucket; cur; cur = cur->next ) {
+        if ( cur->hash == hash && h->eq( cur, key ) ) {
+            return 0;
+        }
+    }
+
+    ( (smh_node_t)node )->hash = hash;
+    ( (smh_node_t)node )->next = *bucket;
+    *bucket = node;
+    h->cnt++;
+
+    if ( h->cnt > h->bucket_cnt ) {
+        smh_rehash( h, 2 * h->bucket_cnt );
+    }
+
+    return 1;
+}
+
+
+st_t smh_find( smh_t h, st_t key )
+{
+    smh_node_t cur;
+    st_size_t  hash;
+
+    hash = h->hash( key );
+
+    for ( cur = h->bucket[ hash & ( h->bucket_cnt - 1 ) ]; cur; cur = cur->next ) {
+        if ( cur->hash == hash && h->eq( cur, key ) ) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+
+st_t smh_remove( smh_t h, st_t key )
+{
+    smh_node_t* ref;
+    smh_node_t  cur;
+    st_size_t   hash;
+
+    hash = h->hash( key );
+
+    for ( ref = &h->bucket[ hash & ( h->bucket_cnt - 1 ) ]; *ref; ref = &( *ref )->next ) {
+        cur = *ref;
+        if ( cur->hash == hash && h->eq( cur, key ) ) {
+            *ref = cur->next;
+            h->cnt--;
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+
+st_size_t smh_count( smh_t h )
+{
+    return h->cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * List:
+ */
+
+sml_t sml_new( st_size_t node_size, st_size_t node_cnt )
+{
+    sml_t l;
+
+    if ( node_size < sizeof( sml_node_s ) ) {
+        return NULL;
+    }
+
+    l = st_alloc( sizeof( sml_s ) );
+    if ( l == NULL ) {
+        return NULL;
+    }
+
+    if ( node_cnt < SM_MIN_SLOT_CNT ) {
+        node_cnt = SM_MIN_SLOT_CNT;
+    }
+
+    l->sm = sm_new( node_cnt, node_size );
+    if ( l->sm == NULL ) {
+        st_del( l );
+        return NULL;
+    }
+    sm_set_resize_factor( l->sm, SMC_RESIZE );
+
+    l->first = NULL;
+    l->last = NULL;
+    l->cnt = 0;
+
+    return l;
+}
+
+
+sml_t sml_del( sml_t l )
+{
+    sm_del( l->sm );
+    st_del( l );
+
+    return NULL;
+}
+
+
+st_none sml_clear( sml_t l )
+{
+    sm_reset( l->sm );
+    l->first = NULL;
+    l->last = NULL;
+    l->cnt = 0;
+}
+
+
+st_t sml_node_get( sml_t l )
+{
+    return sm_get( l->sm );
+}
+
+
+st_none sml_node_put( sml_t l, st_t node )
+{
+    sm_put( l->sm, node );
+}
+
+
+st_none sml_insert_after( sml_t l, st_t pos, st_t node )
+{
+    sml_node_t n;
+    sml_node_t p;
+
+    n = node;
+    p = pos;
+
+    n->prev = p;
+
+    if ( p ) {
+        n->next = p->next;
+        p->next = n;
+    } else {
+        n->next = l->first;
+        l->first = n;
+    }
+
+    if ( n->next ) {
+        n->next->prev = n;
+    } else {
+        l->last = n;
+    }
+
+    l->cnt++;
+}
+
+
+st_none sml_push_front( sml_t l, st_t node )
+{
+    sml_insert_after( l, NULL, node );
+}
+
+
+st_none sml_push_back( sml_t l, st_t node )
+{
+    sml_insert_after( l, l->last, node );
+}
+
+
+st_t sml_remove( sml_t l, st_t node )
+{
+    sml_node_t n;
+
+    n = node;
+
+    if ( n->prev ) {
+        n->prev->next = n->next;
+    } else {
+        l->first = n->next;
+    }
+
+    if ( n->next ) {
+        n->next->prev = n->prev;
+    } else {
+        l->last = n->prev;
+    }
+
+    l->cnt--;
+
+    return n;
+}
+
+
+st_t sml_pop_front( sml_t l )
+{
+    if ( l->first == NULL ) {
+        return NULL;
+    }
+
+    return sml_remove( l, l->first );
+}
+
+
+st_t sml_pop_back( sml_t l )
+{
+    if ( l->last == NULL ) {
+        return NULL;
+    }
+
+    return sml_remove( l, l->last );
+}
+
+
+st_t sml_first( sml_t l )
+{
+    return l->first;
+}
+
+
+st_t sml_last( sml_t l )
+{
+    return l->last;
+}
+
+
+st_size_t sml_count( sml_t l )
+{
+    return l->cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Internal functions:
+ */
+
+/**
+ * Move nodes to new bucket array. Nodes for the new size are
+ * reserved in advance, in one Segment that is sized by the missing
+ * nodes. Segments hence double in size with the buckets. Old buckets
+ * are kept if allocation fails.
+ *
+ * @param h          Hash map.
+ * @param bucket_cnt New bucket count.
+ *
+ * @return NA
+ */
+static st_none smh_rehash( smh_t h, st_size_t bucket_cnt )
+{
+    smh_node_t* bucket;
+    smh_node_t cur;
+    smh_node_t next;
+    st_size_t  i;
+    st_size_t  mask;
+
+    bucket = st_alloc( bucket_cnt * sizeof( smh_node_t ) );
+    if ( bucket == NULL ) {
+        return;
+    }
+    memset( bucket, 0, bucket_cnt * sizeof( smh_node_t ) );
+
+    mask = bucket_cnt - 1;
+
+    for ( i = 0; i < h->bucket_cnt; i++ ) {
+        for ( cur = h->bucket[ i ]; cur; cur = next ) {
+            next = cur->next;
+            cur->next = bucket[ cur->hash & mask ];
+            bucket[ cur->hash & mask ] = cur;
+        }
+    }
+
+    st_del( h->bucket );
+    h->bucket = bucket;
+    h->bucket_cnt = bucket_cnt;
+
+    /* Node that triggers the next rehash is taken before insert. */
+    sm_reserve( h->sm, bucket_cnt + 1 - h->cnt, SM_RESERVE_SINGLE );
+}
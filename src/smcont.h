@@ -0,0 +1,334 @@
+#ifndef SMCONT_H
+#define SMCONT_H
+
+
+/**
+ * @file   smcont.h
+ *
+ * @brief  Segman backed containers.
+ *
+ * Hash map (chained) and doubly linked list, whose nodes are slots
+ * of a Segman owned by the container. Containers are intrusive: the
+ * user node type starts with smh_node_s (or sml_node_s), and user
+ * data follows it.
+ *
+ */
+
+#include "segman.h"
+
+#ifndef SMH_MIN_BUCKET_CNT
+#define SMH_MIN_BUCKET_CNT 16
+#endif
+
+
+st_struct_type( smh );
+st_struct_type( smh_node );
+st_struct_type( sml );
+st_struct_type( sml_node );
+
+
+/** Hash of key. */
+typedef st_size_t ( *smh_hash_fn )( st_t key );
+
+/** Node key equals key (1 for equal). */
+typedef st_size_t ( *smh_eq_fn )( st_t node, st_t key );
+
+
+/** Hash map node header. */
+st_struct_body( smh_node )
+{
+    smh_node_t next; /**< Next node in bucket. */
+    st_size_t  hash; /**< Hash of node key. */
+};
+
+/** Hash map. */
+st_struct_body( smh )
+{
+    sm_t        sm;         /**< Node pool. */
+    smh_node_t* bucket;     /**< Buckets. */
+    st_size_t   bucket_cnt; /**< Number of buckets (power of 2). */
+    st_size_t   cnt;        /**< Number of nodes in map. */
+    smh_hash_fn hash;       /**< Key hash function. */
+    smh_eq_fn   eq;         /**< Key compare function. */
+};
+
+
+/** List node header. */
+st_struct_body( sml_node )
+{
+    sml_node_t next; /**< Next node (NULL for last). */
+    sml_node_t prev; /**< Previous node (NULL for first). */
+};
+
+/** Doubly linked list. */
+st_struct_body( sml )
+{
+    sm_t       sm;    /**< Node pool. */
+    sml_node_t first; /**< First node. */
+    sml_node_t last;  /**< Last node. */
+    st_size_t  cnt;   /**< Number of nodes in list. */
+};
+
+
+
+/* ------------------------------------------------------------
+ * Hash map:
+ */
+
+/**
+ * Create hash map.
+ *
+ * Nodes are allocated from a Segman with "node_cnt" slots in host
+ * Segment. When buckets are doubled, the map reserves the missing
+ * nodes for the new size in one Tail Segment. Tail Segments hence
+ * double in size, and nodes stay in a few large Segments.
+ *
+ * @param node_size Node size (including smh_node_s header).
+ * @param node_cnt  Expected number of nodes.
+ * @param hash      Key hash function.
+ * @param eq        Key compare function.
+ *
+ * @return Hash map (or NULL on failure).
+ */
+smh_t smh_new( st_size_t node_size, st_size_t node_cnt, smh_hash_fn hash, smh_eq_fn eq );
+
+
+/**
+ * Destroy hash map and all nodes.
+ *
+ * @param h Hash map.
+ *
+ * @return NULL.
+ */
+smh_t smh_del( smh_t h );
+
+
+/**
+ * Remove all nodes from hash map. Nodes are returned to pool.
+ *
+ * @param h Hash map.
+ *
+ * @return NA
+ */
+st_none smh_clear( smh_t h );
+
+
+/**
+ * Get unused node from pool.
+ *
+ * @param h Hash map.
+ *
+ * @return Node (or NULL on failure).
+ */
+st_t smh_node_get( smh_t h );
+
+
+/**
+ * Return node (not in map) to pool.
+ *
+ * @param h    Hash map.
+ * @param node Node.
+ *
+ * @return NA
+ */
+st_none smh_node_put( smh_t h, st_t node );
+
+
+/**
+ * Insert node with key to hash map. Node is not inserted if map has
+ * a node with equal key already.
+ *
+ * @param h    Hash map.
+ * @param node Node (from smh_node_get()).
+ * @param key  Key of node.
+ *
+ * @return 1 on success (0 if key exists).
+ */
+st_size_t smh_insert( smh_t h, st_t node, st_t key );
+
+
+/**
+ * Find node with key.
+ *
+ * @param h   Hash map.
+ * @param key Key.
+ *
+ * @return Node (or NULL if not found).
+ */
+st_t smh_find( smh_t h, st_t key );
+
+
+/**
+ * Remove node with key from hash map. Node is not returned to pool.
+ *
+ * @param h   Hash map.
+ * @param key Key.
+ *
+ * @return Node (or NULL if not found).
+ */
+st_t smh_remove( smh_t h, st_t key );
+
+
+/**
+ * Return number of nodes in hash map.
+ *
+ * @param h Hash map.
+ *
+ * @return Count.
+ */
+st_size_t smh_count( smh_t h );
+
+
+
+/* ------------------------------------------------------------
+ * List:
+ */
+
+/**
+ * Create list.
+ *
+ * @param node_size Node size (including sml_node_s header).
+ * @param node_cnt  Number of nodes in host Segment.
+ *
+ * @return List (or NULL on failure).
+ */
+sml_t sml_new( st_size_t node_size, st_size_t node_cnt );
+
+
+/**
+ * Destroy list and all nodes.
+ *
+ * @param l List.
+ *
+ * @return NULL.
+ */
+sml_t sml_del( sml_t l );
+
+
+/**
+ * Remove all nodes from list. Nodes are returned to pool.
+ *
+ * @param l List.
+ *
+ * @return NA
+ */
+st_none sml_clear( sml_t l );
+
+
+/**
+ * Get unused node from pool.
+ *
+ * @param l List.
+ *
+ * @return Node (or NULL on failure).
+ */
+st_t sml_node_get( sml_t l );
+
+
+/**
+ * Return node (not in list) to pool.
+ *
+ * @param l    List.
+ * @param node Node.
+ *
+ * @return NA
+ */
+st_none sml_node_put( sml_t l, st_t node );
+
+
+/**
+ * Insert node after position.
+ *
+ * @param l    List.
+ * @param pos  Position node (NULL for first).
+ * @param node Node.
+ *
+ * @return NA
+ */
+st_none sml_insert_after( sml_t l, st_t pos, st_t node );
+
+
+/**
+ * Add node first.
+ *
+ * @param l    List.
+ * @param node Node.
+ *
+ * @return NA
+ */
+st_none sml_push_front( sml_t l, st_t node );
+
+
+/**
+ * Add node last.
+ *
+ * @param l    List.
+ * @param node Node.
+ *
+ * @return NA
+ */
+st_none sml_push_back( sml_t l, st_t node );
+
+
+/**
+ * Remove node from list. Node is not returned to pool.
+ *
+ * @param l    List.
+ * @param node Node.
+ *
+ * @return Node.
+ */
+st_t sml_remove( sml_t l, st_t node );
+
+
+/**
+ * Remove first node.
+ *
+ * @param l List.
+ *
+ * @return Node (or NULL if list is empty).
+ */
+st_t sml_pop_front( sml_t l );
+
+
+/**
+ * Remove last node.
+ *
+ * @param l List.
+ *
+ * @return Node (or NULL if list is empty).
+ */
+st_t sml_pop_back( sml_t l );
+
+
+/**
+ * Return first node.
+ *
+ * @param l List.
+ *
+ * @return Node (or NULL if list is empty).
+ */
+st_t sml_first( sml_t l );
+
+
+/**
+ * Return last node.
+ *
+ * @param l List.
+ *
+ * @return Node (or NULL if list is empty).
+ */
+st_t sml_last( sml_t l );
+
+
+/**
+ * Return number of nodes in list.
+ *
+ * @param l List.
+ *
+ * @return Count.
+ */
+st_size_t sml_count( sml_t l );
+
+
+#endif
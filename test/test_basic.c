@@ -7,6 +7,7 @@
  * - basic (queries, factor)
  * - random.
  * - block (queries, factor)
+ * - reset (lazy Tail Segment reset)
  */
 
 
@@ -318,3 +319,68 @@ void test_large( void )
         }
     }
 }
+
+
+void test_reset( void )
+{
+    sm_t      sm;
+    sm_tail_t cur;
+    my_slot_p slot;
+    my_slot_p prev;
+    st_size_t total;
+    st_size_t seg_cnt;
+    int       round;
+    st_id_t   i;
+
+    sm = sm_new( 16, sizeof( my_slot_t ) );
+    sm_set_resize_factor( sm, 100 );
+
+    for ( i = 0; i < 16 * 20; i++ ) {
+        sm_get( sm );
+    }
+
+    seg_cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        seg_cnt++;
+    }
+    total = sm_total_count( sm );
+
+    for ( round = 0; round < 3; round++ ) {
+
+        sm_reset( sm );
+        TEST_ASSERT( sm->tail == &sm->host );
+        TEST_ASSERT( sm->host.init_cnt == 0 );
+
+        /* Tail Segments are not touched at reset. */
+        TEST_ASSERT( sm->host.next->init_cnt == sm->host.next->tail_cnt );
+
+        /* Slots are given in order, Segment by Segment. */
+        prev = NULL;
+        for ( i = 0; i < (st_id_t)total; i++ ) {
+            slot = sm_get( sm );
+            TEST_ASSERT( slot != NULL );
+            if ( i % 16 != 0 ) {
+                TEST_ASSERT( (st_t)slot == (st_t)prev + sm->slot_size );
+            }
+            slot->id = i;
+            prev = slot;
+        }
+        TEST_ASSERT( sm_used_count( sm ) == total );
+        TEST_ASSERT( sm_free_count( sm ) == 0 );
+
+        /* No new Segments. */
+        i = 0;
+        for ( cur = &sm->host; cur; cur = cur->next ) {
+            i++;
+        }
+        TEST_ASSERT( (st_size_t)i == seg_cnt );
+
+        /* Partially used before the next reset. */
+        sm_reset( sm );
+        for ( i = 0; i < 16 * 3 + 5; i++ ) {
+            sm_get( sm );
+        }
+    }
+
+    sm_del( sm );
+}
@@ -0,0 +1,235 @@
+#include "unity.h"
+#include "segman.h"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - budget (charge, refuse, trim, idle, detach)
+ * - budget wait (release by another thread, timeout)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define BLOCK_SIZE 1024
+#define SLOT_SIZE  64
+
+
+st_t ptr[ 1024 ];
+st_t tmp[ 1024 ];
+st_t aux[ 1024 ];
+
+
+/* Host allocation size, as charged to budget. */
+st_size_t host_bytes( void )
+{
+    sm_budget_t bg;
+    sm_t        sm;
+    st_size_t   bytes;
+
+    bg = sm_budget_new( 0, 0 );
+    sm = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    sm_set_budget( sm, bg );
+    bytes = sm_budget_used( bg );
+    sm_del( sm );
+    sm_budget_del( bg );
+
+    return bytes;
+}
+
+
+/* Get slots until out-of-slots, return count. */
+int get_all( sm_t sm, st_t* slot )
+{
+    int i;
+
+    for ( i = 0; i < 1024; i++ ) {
+        slot[ i ] = sm_get( sm );
+        if ( slot[ i ] == NULL ) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+
+uint64_t now_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Trim Segman after a delay. */
+void* trimmer( void* arg )
+{
+    usleep( 50000 );
+    sm_trim( arg );
+
+    return NULL;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_budget( void )
+{
+    sm_budget_t bg;
+    sm_t        a;
+    sm_t        b;
+    st_size_t   host;
+    int         free_cnt;
+    int         b_cnt;
+    int         cnt;
+    int         i;
+
+    host = host_bytes();
+    TEST_ASSERT( host >= BLOCK_SIZE );
+
+    bg = sm_budget_new( 2 * host + 3 * BLOCK_SIZE, 0 );
+    TEST_ASSERT( sm_budget_used( bg ) == 0 );
+
+    a = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    b = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    TEST_ASSERT( sm_set_budget( a, bg ) == 1 );
+    TEST_ASSERT( sm_set_budget( b, bg ) == 1 );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host );
+
+    /* Growth is refused at limit. */
+    cnt = get_all( a, ptr );
+    TEST_ASSERT( cnt < 1024 );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + 3 * BLOCK_SIZE );
+    TEST_ASSERT( sm_get( a ) == NULL );
+
+    b_cnt = get_all( b, tmp );
+    TEST_ASSERT( b_cnt == (int)sm_total_count( b ) );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + 3 * BLOCK_SIZE );
+
+    /* Segments with a used slot are kept. */
+    for ( i = 0; i < cnt; i++ ) {
+        if ( i != cnt - 1 ) {
+            sm_put( a, ptr[ i ] );
+        }
+    }
+    TEST_ASSERT( sm_trim( a ) == 2 * BLOCK_SIZE );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + BLOCK_SIZE );
+    TEST_ASSERT( sm_used_count( a ) == 1 );
+    free_cnt = sm_free_count( a );
+    for ( i = 0; i < free_cnt; i++ ) {
+        aux[ i ] = sm_get( a );
+        TEST_ASSERT( aux[ i ] != ptr[ cnt - 1 ] );
+    }
+    for ( i = 0; i < free_cnt; i++ ) {
+        sm_put( a, aux[ i ] );
+    }
+
+    /* Empty Segments are given back. */
+    sm_put( a, ptr[ cnt - 1 ] );
+    TEST_ASSERT( sm_trim( a ) == BLOCK_SIZE );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host );
+    TEST_ASSERT( sm_trim( a ) == 0 );
+    TEST_ASSERT( sm_get( a ) != NULL );
+
+    /* Other Segman can grow now. */
+    tmp[ b_cnt ] = sm_get( b );
+    TEST_ASSERT( tmp[ b_cnt ] != NULL );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + BLOCK_SIZE );
+    b_cnt += get_all( b, tmp + b_cnt + 1 ) + 1;
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + 3 * BLOCK_SIZE );
+
+    /* Idle Segman above its share is trimmed, if it has free slots. */
+    TEST_ASSERT( sm_idle( a ) == 0 );
+    TEST_ASSERT( sm_idle( b ) == 0 );
+    for ( i = 0; i < b_cnt; i++ ) {
+        sm_put( b, tmp[ i ] );
+    }
+    TEST_ASSERT( sm_idle( b ) == 1 );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host );
+
+    /* Reserved Segments are kept with fixed mode. */
+    TEST_ASSERT( sm_reserve( b, sm_total_count( b ) + 1, SM_RESERVE_FIXED ) == 1 );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + BLOCK_SIZE );
+    TEST_ASSERT( sm_trim( b ) == 0 );
+    TEST_ASSERT( sm_reserve( b, 1024, 0 ) == 0 );
+
+    /* Detach and delete release charges. */
+    TEST_ASSERT( sm_set_budget( b, NULL ) == 1 );
+    TEST_ASSERT( sm_budget_used( bg ) == host );
+    sm_del( a );
+    TEST_ASSERT( sm_budget_used( bg ) == 0 );
+    sm_del( b );
+
+    sm_budget_del( bg );
+}
+
+
+void test_budget_wait( void )
+{
+    sm_budget_t bg;
+    sm_t        a;
+    sm_t        b;
+    pthread_t   thread;
+    st_size_t   host;
+    uint64_t    start;
+    int         cnt;
+    int         i;
+
+    host = host_bytes();
+
+    /* Release by another thread. */
+    bg = sm_budget_new( 2 * host + BLOCK_SIZE, 5000 );
+    a = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    b = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    sm_set_budget( a, bg );
+    sm_set_budget( b, bg );
+
+    cnt = get_all( b, tmp );
+    TEST_ASSERT( cnt == (int)sm_total_count( b ) );
+    for ( i = 0; i < cnt; i++ ) {
+        sm_put( b, tmp[ i ] );
+    }
+    sm_reset( b );
+
+    cnt = sm_free_count( a );
+    for ( i = 0; i < cnt; i++ ) {
+        TEST_ASSERT( sm_get( a ) != NULL );
+    }
+
+    pthread_create( &thread, NULL, trimmer, b );
+    TEST_ASSERT( sm_get( a ) != NULL );
+    pthread_join( thread, NULL );
+    TEST_ASSERT( sm_budget_used( bg ) == 2 * host + BLOCK_SIZE );
+
+    sm_del( a );
+    sm_del( b );
+    sm_budget_del( bg );
+
+    /* Timeout. */
+    bg = sm_budget_new( host, 50 );
+    a = sm_new_block( BLOCK_SIZE, SLOT_SIZE );
+    sm_set_budget( a, bg );
+
+    cnt = sm_free_count( a );
+    for ( i = 0; i < cnt; i++ ) {
+        TEST_ASSERT( sm_get( a ) != NULL );
+    }
+
+    start = now_ms();
+    TEST_ASSERT( sm_get( a ) == NULL );
+    TEST_ASSERT( now_ms() - start >= 45 );
+
+    sm_del( a );
+    sm_budget_del( bg );
+}
@@ -0,0 +1,238 @@
+#include "unity.h"
+#include "segman.h"
+
+
+/*
+ * Tests:
+ * - clone (content, free list, translation, independence)
+ * - clone block and object mode
+ * - clone refused
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT 16
+
+typedef struct my_slot_s
+{
+    st_t              link;
+    st_id_t           id;
+    struct my_slot_s* next;
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+my_slot_p ptr[ 8 * SLOT_CNT ];
+
+
+void my_ctor( sm_t sm, st_t slot )
+{
+    sm = sm;
+    ( (my_slot_p)slot )->id = 1000;
+}
+
+
+/* Slots in all Segments of Segman. */
+st_size_t slot_total( sm_t sm )
+{
+    sm_tail_t cur;
+    st_size_t cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt += cur->tail_cnt;
+    }
+
+    return cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_clone( void )
+{
+    sm_t      sm;
+    sm_t      cl;
+    sm_xlat_t xlat;
+    my_slot_p s;
+    my_slot_p c;
+    my_slot_p prev;
+    int       i;
+    int       cnt;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_resize_factor( sm, 200 );
+
+    /* Chain of slots over several Segments. */
+    cnt = 5 * SLOT_CNT;
+    for ( i = 0; i < cnt; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        ptr[ i ]->id = i;
+    }
+
+    /* Free every third, and chain the rest. */
+    prev = NULL;
+    for ( i = 0; i < cnt; i++ ) {
+        if ( i % 3 == 0 ) {
+            sm_put( sm, ptr[ i ] );
+            ptr[ i ] = NULL;
+        } else {
+            ptr[ i ]->next = prev;
+            prev = ptr[ i ];
+        }
+    }
+
+    cl = sm_clone( sm, &xlat );
+    TEST_ASSERT( cl != NULL );
+    TEST_ASSERT( xlat != NULL );
+    TEST_ASSERT( sm_used_count( cl ) == sm_used_count( sm ) );
+    TEST_ASSERT( sm_free_count( cl ) == sm_free_count( sm ) );
+    TEST_ASSERT( slot_total( cl ) == slot_total( sm ) );
+
+    /* Outside addresses are not translated. */
+    TEST_ASSERT( sm_xlat( xlat, NULL ) == NULL );
+    TEST_ASSERT( sm_xlat( xlat, &i ) == (st_t)&i );
+
+    /* Content is copied, and pointers are translated by user. */
+    for ( i = 0; i < cnt; i++ ) {
+        if ( ptr[ i ] == NULL ) {
+            continue;
+        }
+        c = sm_xlat( xlat, ptr[ i ] );
+        TEST_ASSERT( c != (st_t)ptr[ i ] );
+        TEST_ASSERT( c->id == (st_id_t)i );
+        c->next = sm_xlat( xlat, c->next );
+    }
+    c = sm_xlat( xlat, prev );
+    for ( i = cnt - 1; i > 0; i-- ) {
+        if ( ptr[ i ] ) {
+            TEST_ASSERT( c->id == (st_id_t)i );
+            c = c->next;
+        }
+    }
+    TEST_ASSERT( c == NULL );
+
+    /* Free lists match, and the copy is independent. */
+    cnt = sm_free_count( sm );
+    TEST_ASSERT( cnt > SLOT_CNT );
+    for ( i = 0; i < cnt; i++ ) {
+        s = sm_get( sm );
+        c = sm_get( cl );
+        TEST_ASSERT( c == sm_xlat( xlat, s ) );
+        s->id = 1;
+        c->id = 2;
+    }
+    for ( i = 0; i < 5 * SLOT_CNT; i++ ) {
+        if ( ptr[ i ] ) {
+            TEST_ASSERT( ptr[ i ]->id == (st_id_t)i );
+        }
+    }
+    TEST_ASSERT( sm_used_count( cl ) == sm_used_count( sm ) );
+
+    sm_xlat_del( xlat );
+    sm_del( cl );
+
+    /* Clone without translation, after reset. */
+    sm_reset( sm );
+    cl = sm_clone( sm, NULL );
+    TEST_ASSERT( cl != NULL );
+    TEST_ASSERT( sm_used_count( cl ) == 0 );
+    for ( i = 0; i < 5 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( cl );
+        TEST_ASSERT( ptr[ i ] != NULL );
+    }
+    TEST_ASSERT( slot_total( cl ) == slot_total( sm ) );
+    sm_del( cl );
+
+    sm_del( sm );
+}
+
+
+void test_clone_block( void )
+{
+    sm_t      sm;
+    sm_t      cl;
+    sm_xlat_t xlat;
+    my_slot_p s;
+    my_slot_p c;
+    int       i;
+    int       cnt;
+
+    /* Block mode. */
+    sm = sm_new_block( 512, sizeof( my_slot_t ) );
+    sm_set_resize_factor( sm, 200 );
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        ptr[ i ]->id = i;
+    }
+    for ( i = 1; i < 4 * SLOT_CNT; i += 2 ) {
+        sm_put( sm, ptr[ i ] );
+    }
+
+    cl = sm_clone( sm, &xlat );
+    TEST_ASSERT( cl != NULL );
+    for ( i = 0; i < 4 * SLOT_CNT; i += 2 ) {
+        c = sm_xlat( xlat, ptr[ i ] );
+        TEST_ASSERT( c->id == (st_id_t)i );
+    }
+    cnt = sm_free_count( sm );
+    for ( i = 0; i < cnt; i++ ) {
+        s = sm_get( sm );
+        c = sm_get( cl );
+        TEST_ASSERT( c == sm_xlat( xlat, s ) );
+    }
+
+    sm_xlat_del( xlat );
+    sm_del( cl );
+    sm_del( sm );
+
+    /* Object mode, slot content is kept and links are at offset. */
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_resize_factor( sm, 200 );
+    TEST_ASSERT( sm_set_object( sm, my_ctor, NULL, 2 * sizeof( st_t ) ) == 1 );
+
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        ptr[ i ]->id = i;
+    }
+    for ( i = 0; i < 3 * SLOT_CNT; i += 2 ) {
+        sm_put( sm, ptr[ i ] );
+    }
+
+    cl = sm_clone( sm, &xlat );
+    TEST_ASSERT( cl != NULL );
+    TEST_ASSERT( cl->flags & SM_FLAG_OBJECT );
+    cnt = sm_free_count( sm );
+    for ( i = 0; i < cnt; i++ ) {
+        s = sm_get( sm );
+        c = sm_get( cl );
+        TEST_ASSERT( c == sm_xlat( xlat, s ) );
+        TEST_ASSERT( c->id == s->id );
+    }
+
+    sm_xlat_del( xlat );
+    sm_del( cl );
+    sm_del( sm );
+}
+
+
+void test_clone_refused( void )
+{
+    sm_t sm;
+    st_t run;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    run = sm_get_run( sm, 4 );
+    TEST_ASSERT( run != NULL );
+    TEST_ASSERT( sm_clone( sm, NULL ) == NULL );
+
+    sm_del( sm );
+}
@@ -0,0 +1,156 @@
+#include "unity.h"
+#include "segman.h"
+
+
+/*
+ * Tests:
+ * - color block (power-of-two sizes)
+ * - color (non-block)
+ * - color per Segman
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SEG_CNT 8
+
+
+/* Offset of slot area from Segment start. */
+st_size_t color_of( sm_tail_t seg )
+{
+    return seg->base - (st_t)seg;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_color_block( void )
+{
+    sm_t      sm;
+    sm_tail_t cur;
+    st_size_t slot_cnt;
+    st_size_t off;
+    st_size_t prev;
+    st_t      slot;
+    int       i;
+
+    sm = sm_new_block( 4096, 256 );
+
+    /* Host and a few tails. */
+    for ( i = 0; i < SEG_CNT * 15; i++ ) {
+        slot = sm_get( sm );
+        TEST_ASSERT( slot != NULL );
+        *( (st_id_t*)( slot + 248 ) ) = i;
+    }
+
+    slot_cnt = ( 4096 - 256 ) / 256;
+    prev = 0;
+
+    for ( cur = sm->host.next; cur; cur = cur->next ) {
+
+        off = color_of( cur );
+
+        /* Same slot count, within block, at cache line. */
+        TEST_ASSERT( cur->tail_cnt == slot_cnt );
+        TEST_ASSERT( off >= sizeof( sm_tail_s ) );
+        TEST_ASSERT( off + slot_cnt * 256 <= 4096 );
+        TEST_ASSERT( off % SM_CACHE_LINE == 0 );
+
+        /* Consecutive Segments have different colors. */
+        TEST_ASSERT( off != prev );
+        prev = off;
+    }
+
+    TEST_ASSERT( sm_used_count( sm ) == SEG_CNT * 15 );
+
+    sm_del( sm );
+}
+
+
+void test_color( void )
+{
+    sm_t      sm;
+    sm_tail_t cur;
+    st_size_t off;
+    st_size_t prev;
+    int       i;
+
+    sm = sm_new( 16, 512 );
+
+    for ( i = 0; i < SEG_CNT * 16; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+
+    prev = 0;
+    for ( cur = sm->host.next; cur; cur = cur->next ) {
+        off = color_of( cur );
+        TEST_ASSERT( off >= sizeof( sm_tail_s ) );
+        TEST_ASSERT( off < sizeof( sm_tail_s ) + 512 );
+        TEST_ASSERT( ( off - sizeof( sm_tail_s ) ) % SM_CACHE_LINE == 0 );
+        TEST_ASSERT( off != prev );
+        prev = off;
+    }
+
+    /* Small slots have no colors. */
+    sm_del( sm );
+    sm = sm_new( 4, 16 );
+
+    for ( i = 0; i < 4 * 4; i++ ) {
+        sm_get( sm );
+    }
+
+    for ( cur = sm->host.next; cur; cur = cur->next ) {
+        TEST_ASSERT( color_of( cur ) == sizeof( sm_tail_s ) );
+    }
+
+    sm_del( sm );
+}
+
+
+void test_color_own( void )
+{
+    sm_t      sm1;
+    sm_t      sm2;
+    sm_tail_t cur1;
+    sm_tail_t cur2;
+    int       i;
+
+    sm1 = sm_new( 16, 512 );
+    sm2 = sm_new( 16, 512 );
+
+    /* Interleaved growth, both start from the first color. */
+    for ( i = 0; i < SEG_CNT * 16; i++ ) {
+        TEST_ASSERT( sm_get( sm1 ) != NULL );
+        TEST_ASSERT( sm_get( sm2 ) != NULL );
+    }
+
+    cur2 = sm2->host.next;
+    for ( cur1 = sm1->host.next; cur1; cur1 = cur1->next ) {
+        TEST_ASSERT( color_of( cur1 ) == color_of( cur2 ) );
+        cur2 = cur2->next;
+    }
+    TEST_ASSERT( color_of( sm1->host.next ) == sizeof( sm_tail_s ) );
+
+    /* Plain Segman has no extension state for colors. */
+    TEST_ASSERT( sm1->ext == NULL );
+
+    /* Rotation continues with extension state. */
+    cur2 = sm2->host.next;
+    while ( cur2->next ) {
+        cur2 = cur2->next;
+    }
+    TEST_ASSERT( sm_set_low_water( sm2, 0 ) == 1 );
+    for ( i = 0; i < 16; i++ ) {
+        TEST_ASSERT( sm_get( sm2 ) != NULL );
+    }
+    TEST_ASSERT( cur2->next != NULL );
+    TEST_ASSERT( color_of( cur2->next ) != color_of( cur2 ) );
+
+    sm_del( sm1 );
+    sm_del( sm2 );
+}
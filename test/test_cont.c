@@ -0,0 +1,252 @@
+#include "unity.h"
+#include "smcont.h"
+
+
+/*
+ * Tests:
+ * - hash (insert, find, remove, rehash, clear)
+ * - list (push, insert, remove, pop, clear)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define NODE_CNT 1000
+
+typedef struct
+{
+    smh_node_s node;
+    st_id_t    key;
+    st_id_t    value;
+} my_entry_t;
+typedef my_entry_t* my_entry_p;
+
+typedef struct
+{
+    sml_node_s node;
+    st_id_t    id;
+} my_item_t;
+typedef my_item_t* my_item_p;
+
+
+st_size_t entry_hash( st_t key )
+{
+    /* Poor hash, to get collisions. */
+    return *( (st_id_t*)key ) % 97;
+}
+
+
+st_size_t entry_eq( st_t node, st_t key )
+{
+    return ( (my_entry_p)node )->key == *( (st_id_t*)key );
+}
+
+
+/* Check list order with ids (forward and backward). */
+int list_is( sml_t l, st_id_t* ids, int cnt )
+{
+    sml_node_t cur;
+    int        i;
+
+    if ( (int)sml_count( l ) != cnt ) {
+        return 0;
+    }
+
+    i = 0;
+    for ( cur = sml_first( l ); cur; cur = cur->next ) {
+        if ( i >= cnt || ( (my_item_p)cur )->id != ids[ i ] ) {
+            return 0;
+        }
+        i++;
+    }
+
+    for ( cur = sml_last( l ); cur; cur = cur->prev ) {
+        i--;
+        if ( ( (my_item_p)cur )->id != ids[ i ] ) {
+            return 0;
+        }
+    }
+
+    return i == 0;
+}
+
+
+/* Slots in all Segments of Segman. */
+st_size_t slot_total( sm_t sm )
+{
+    sm_tail_t cur;
+    st_size_t cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt += cur->tail_cnt;
+    }
+
+    return cnt;
+}
+
+
+/* Number of Segments in Segman. */
+st_size_t seg_count( sm_t sm )
+{
+    sm_tail_t cur;
+    st_size_t cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+my_item_p item_new( sml_t l, st_id_t id )
+{
+    my_item_p item;
+
+    item = sml_node_get( l );
+    item->id = id;
+
+    return item;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_hash( void )
+{
+    smh_t      h;
+    my_entry_p e;
+    st_id_t    key;
+    st_size_t  bucket_cnt;
+
+    TEST_ASSERT( smh_new( sizeof( st_t ), 16, entry_hash, entry_eq ) == NULL );
+
+    h = smh_new( sizeof( my_entry_t ), 16, entry_hash, entry_eq );
+    bucket_cnt = h->bucket_cnt;
+    TEST_ASSERT( bucket_cnt == SMH_MIN_BUCKET_CNT );
+
+    for ( key = 0; key < NODE_CNT; key++ ) {
+        e = smh_node_get( h );
+        e->key = key;
+        e->value = 2 * key;
+        TEST_ASSERT( smh_insert( h, e, &key ) == 1 );
+    }
+
+    TEST_ASSERT( smh_count( h ) == NODE_CNT );
+    TEST_ASSERT( h->bucket_cnt > bucket_cnt );
+    TEST_ASSERT( h->bucket_cnt >= NODE_CNT );
+
+    /* Segments double with buckets. */
+    TEST_ASSERT( seg_count( h->sm ) <= 8 );
+    TEST_ASSERT( h->sm->resize == 200 );
+
+    /* Duplicate key. */
+    key = 10;
+    e = smh_node_get( h );
+    e->key = key;
+    TEST_ASSERT( smh_insert( h, e, &key ) == 0 );
+    smh_node_put( h, e );
+
+    for ( key = 0; key < NODE_CNT; key++ ) {
+        e = smh_find( h, &key );
+        TEST_ASSERT( e != NULL );
+        TEST_ASSERT( e->key == key );
+        TEST_ASSERT( e->value == 2 * key );
+    }
+
+    key = NODE_CNT;
+    TEST_ASSERT( smh_find( h, &key ) == NULL );
+    TEST_ASSERT( smh_remove( h, &key ) == NULL );
+
+    /* Remove even keys. */
+    for ( key = 0; key < NODE_CNT; key += 2 ) {
+        e = smh_remove( h, &key );
+        TEST_ASSERT( e != NULL && e->key == key );
+        smh_node_put( h, e );
+    }
+
+    TEST_ASSERT( smh_count( h ) == NODE_CNT / 2 );
+    for ( key = 0; key < NODE_CNT; key++ ) {
+        TEST_ASSERT( ( smh_find( h, &key ) != NULL ) == ( key % 2 == 1 ) );
+    }
+
+    /* Nodes are reserved for the bucket count. */
+    TEST_ASSERT( slot_total( h->sm ) >= h->bucket_cnt );
+    TEST_ASSERT( sm_used_count( h->sm ) == NODE_CNT / 2 );
+
+    smh_clear( h );
+    TEST_ASSERT( smh_count( h ) == 0 );
+    TEST_ASSERT( sm_used_count( h->sm ) == 0 );
+    key = 1;
+    TEST_ASSERT( smh_find( h, &key ) == NULL );
+
+    e = smh_node_get( h );
+    e->key = key;
+    TEST_ASSERT( smh_insert( h, e, &key ) == 1 );
+    TEST_ASSERT( smh_find( h, &key ) == e );
+
+    TEST_ASSERT( smh_del( h ) == NULL );
+}
+
+
+void test_list( void )
+{
+    sml_t     l;
+    my_item_p a;
+    my_item_p b;
+    my_item_p c;
+    my_item_p d;
+    int       i;
+
+    TEST_ASSERT( sml_new( sizeof( st_t ), 16 ) == NULL );
+
+    l = sml_new( sizeof( my_item_t ), 16 );
+    TEST_ASSERT( sml_first( l ) == NULL && sml_last( l ) == NULL );
+    TEST_ASSERT( sml_pop_front( l ) == NULL );
+    TEST_ASSERT( sml_pop_back( l ) == NULL );
+
+    a = item_new( l, 1 );
+    b = item_new( l, 2 );
+    c = item_new( l, 3 );
+    d = item_new( l, 4 );
+
+    sml_push_back( l, b );
+    sml_push_front( l, a );
+    sml_push_back( l, d );
+    sml_insert_after( l, b, c );
+    TEST_ASSERT( list_is( l, (st_id_t[]){ 1, 2, 3, 4 }, 4 ) );
+
+    TEST_ASSERT( sml_remove( l, b ) == b );
+    TEST_ASSERT( list_is( l, (st_id_t[]){ 1, 3, 4 }, 3 ) );
+    sml_node_put( l, b );
+
+    TEST_ASSERT( sml_pop_front( l ) == a );
+    TEST_ASSERT( sml_pop_back( l ) == d );
+    TEST_ASSERT( list_is( l, (st_id_t[]){ 3 }, 1 ) );
+    TEST_ASSERT( sml_pop_back( l ) == c );
+    TEST_ASSERT( list_is( l, NULL, 0 ) );
+    sml_node_put( l, a );
+    sml_node_put( l, c );
+    sml_node_put( l, d );
+
+    for ( i = 0; i < NODE_CNT; i++ ) {
+        sml_push_front( l, item_new( l, NODE_CNT - 1 - i ) );
+    }
+    TEST_ASSERT( sml_count( l ) == NODE_CNT );
+    TEST_ASSERT( ( (my_item_p)sml_first( l ) )->id == 0 );
+    TEST_ASSERT( ( (my_item_p)sml_last( l ) )->id == NODE_CNT - 1 );
+    TEST_ASSERT( sm_used_count( l->sm ) == NODE_CNT );
+
+    sml_clear( l );
+    TEST_ASSERT( sml_count( l ) == 0 && sml_first( l ) == NULL );
+    TEST_ASSERT( sm_used_count( l->sm ) == 0 );
+
+    TEST_ASSERT( sml_del( l ) == NULL );
+}
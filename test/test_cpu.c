@@ -0,0 +1,138 @@
+#include "unity.h"
+#include "segman.h"
+#include <pthread.h>
+
+
+/*
+ * Tests:
+ * - cpu (single thread)
+ * - cpu threads
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT   SM_MIN_SLOT_CNT
+#define THREAD_CNT 4
+#define ROUNDS     20000
+#define LIVE_CNT   100
+
+typedef struct
+{
+    union
+    {
+        st_t    ptr;
+        st_id_t id;
+    };
+    st_id_t owner;
+    char    name[ 16 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+int thread_fail = 0;
+
+void* worker( void* arg )
+{
+    sm_cpu_t  smc = arg;
+    my_slot_p live[ LIVE_CNT ];
+    st_id_t   i;
+    st_id_t   n;
+    st_id_t   self;
+
+    self = (st_id_t)live;
+
+    for ( n = 0; n < LIVE_CNT; n++ ) {
+        live[ n ] = NULL;
+    }
+
+    for ( i = 0; i < ROUNDS; i++ ) {
+        n = i % LIVE_CNT;
+        if ( live[ n ] ) {
+            if ( live[ n ]->owner != self || live[ n ]->id != i - LIVE_CNT ) {
+                __atomic_add_fetch( &thread_fail, 1, __ATOMIC_RELAXED );
+            }
+            sm_cpu_put( smc, live[ n ] );
+        }
+        live[ n ] = sm_cpu_get( smc );
+        live[ n ]->owner = self;
+        live[ n ]->id = i;
+    }
+
+    for ( n = 0; n < LIVE_CNT; n++ ) {
+        sm_cpu_put( smc, live[ n ] );
+    }
+
+    return NULL;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_cpu( void )
+{
+    sm_t      sm;
+    sm_cpu_t  smc;
+    my_slot_p ptr[ 10 * SLOT_CNT ];
+    st_id_t   i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    smc = sm_cpu_new( sm, 8 );
+    TEST_ASSERT( smc != NULL );
+
+    for ( i = 0; i < 10 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_cpu_get( smc );
+        TEST_ASSERT( ptr[ i ] != NULL );
+        ptr[ i ]->id = i;
+    }
+
+    for ( i = 0; i < 10 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( ptr[ i ]->id == i );
+        sm_cpu_put( smc, ptr[ i ] );
+    }
+
+    /* Some slots are cached. */
+    TEST_ASSERT( sm_used_count( sm ) <= 8 );
+
+    /* Cached slot is re-used first. */
+    TEST_ASSERT( sm_cpu_get( smc ) == ptr[ 10 * SLOT_CNT - 1 ] );
+    sm_cpu_put( smc, ptr[ 10 * SLOT_CNT - 1 ] );
+
+    sm_cpu_del( smc );
+    TEST_ASSERT( sm_used_count( sm ) == 0 );
+
+    sm_del( sm );
+}
+
+
+void test_cpu_threads( void )
+{
+    sm_t      sm;
+    sm_cpu_t  smc;
+    pthread_t thread[ THREAD_CNT ];
+    int       i;
+
+    sm = sm_new( 64, sizeof( my_slot_t ) );
+    smc = sm_cpu_new( sm, 0 );
+
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        pthread_create( &thread[ i ], NULL, worker, smc );
+    }
+
+    for ( i = 0; i < THREAD_CNT; i++ ) {
+        pthread_join( thread[ i ], NULL );
+    }
+
+    TEST_ASSERT( thread_fail == 0 );
+
+    sm_cpu_del( smc );
+    TEST_ASSERT( sm_used_count( sm ) == 0 );
+    TEST_ASSERT( sm_total_count( sm ) >= LIVE_CNT );
+
+    sm_del( sm );
+}
@@ -0,0 +1,235 @@
+#include "unity.h"
+#include "segman.h"
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - decommit (free Tail pages released and re-used, Host kept)
+ * - decommit tail (lazy tail, reset)
+ * - idle decommit
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT 4096
+
+typedef struct
+{
+    st_t    link;
+    st_id_t id;
+    char    name[ 48 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+my_slot_p ptr[ 2 * SLOT_CNT ];
+
+
+int seg_cnt( sm_t sm )
+{
+    sm_tail_t cur;
+    int       cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+/* Page of address is resident. */
+int resident( st_t addr )
+{
+    uintptr_t     page;
+    unsigned char vec;
+
+    page = (uintptr_t)addr & ~( (uintptr_t)sysconf( _SC_PAGESIZE ) - 1 );
+    mincore( (void*)page, 1, &vec );
+
+    return vec & 1;
+}
+
+
+/* Get "cnt" slots to ptr[first...], and check that all are unique. */
+int get_unique( sm_t sm, int first, int cnt )
+{
+    int i;
+
+    for ( i = first; i < first + cnt; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        if ( ptr[ i ] == NULL ) {
+            return 0;
+        }
+        ptr[ i ]->id = i;
+    }
+
+    for ( i = 0; i < first + cnt; i++ ) {
+        if ( ptr[ i ] && ptr[ i ]->id != i ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_decommit( void )
+{
+    sm_t      sm;
+    my_slot_p host;
+    int       i;
+    int       n;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    /* Host and one Tail. */
+    TEST_ASSERT( get_unique( sm, 0, 2 * SLOT_CNT ) );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+    TEST_ASSERT( resident( ptr[ SLOT_CNT + SLOT_CNT / 4 ] ) );
+    host = ptr[ SLOT_CNT / 4 ];
+
+    /* Keep first of Host, and first, middle and last of Tail. */
+    for ( i = 1; i < 2 * SLOT_CNT - 1; i++ ) {
+        if ( i != SLOT_CNT && i != SLOT_CNT + SLOT_CNT / 2 ) {
+            sm_put( sm, ptr[ i ] );
+            ptr[ i ] = NULL;
+        }
+    }
+
+    TEST_ASSERT( sm_decommit( sm ) == 1 );
+
+    /* Host pages are kept. */
+    TEST_ASSERT( resident( host ) );
+
+    TEST_ASSERT( !resident( ptr[ SLOT_CNT ] + SLOT_CNT / 4 ) );
+    TEST_ASSERT( resident( ptr[ SLOT_CNT + SLOT_CNT / 2 ] ) );
+    TEST_ASSERT( ptr[ SLOT_CNT + SLOT_CNT / 2 ]->id == SLOT_CNT + SLOT_CNT / 2 );
+
+    /* Released slots are still free. */
+    TEST_ASSERT( sm_free_count( sm ) == 2 * SLOT_CNT - 4 );
+    TEST_ASSERT( sm_total_count( sm ) == 2 * SLOT_CNT );
+
+    /* Decommit again, with nothing new. */
+    TEST_ASSERT( sm_decommit( sm ) == 1 );
+    TEST_ASSERT( sm_free_count( sm ) == 2 * SLOT_CNT - 4 );
+
+    /* All slots are re-used before a new Segment. */
+    n = 0;
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        if ( ptr[ i ] == NULL ) {
+            ptr[ i ] = sm_get( sm );
+            TEST_ASSERT( ptr[ i ] != NULL );
+            ptr[ i ]->id = i;
+            n++;
+        }
+    }
+
+    TEST_ASSERT( n == 2 * SLOT_CNT - 4 );
+    TEST_ASSERT( get_unique( sm, 0, 0 ) );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+    TEST_ASSERT( sm_free_count( sm ) == 0 );
+
+    TEST_ASSERT( sm_get( sm ) != NULL );
+    TEST_ASSERT( seg_cnt( sm ) == 3 );
+
+    sm_del( sm );
+}
+
+
+void test_decommit_tail( void )
+{
+    sm_t      sm;
+    st_size_t total;
+    int       i;
+
+    sm = sm_new( SLOT_CNT / 4, sizeof( my_slot_t ) );
+
+    /* Tail Segment is partly initialized. */
+    TEST_ASSERT( get_unique( sm, 0, SLOT_CNT / 2 - 100 ) );
+    TEST_ASSERT( sm->tail->init_cnt < sm->tail->tail_cnt );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+
+    for ( i = 0; i < SLOT_CNT / 2 - 100; i++ ) {
+        if ( i % 512 != 0 ) {
+            sm_put( sm, ptr[ i ] );
+            ptr[ i ] = NULL;
+        }
+    }
+
+    total = sm_total_count( sm );
+    TEST_ASSERT( sm_decommit( sm ) == 1 );
+    TEST_ASSERT( sm_total_count( sm ) == total );
+    TEST_ASSERT( sm_used_count( sm ) == 4 );
+
+    TEST_ASSERT( get_unique( sm, SLOT_CNT / 2 - 100, total - 4 ) );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+    TEST_ASSERT( sm_free_count( sm ) == 0 );
+
+    /* Reset after decommit. */
+    for ( i = 0; i < (int)total; i++ ) {
+        if ( ptr[ i ] ) {
+            sm_put( sm, ptr[ i ] );
+        }
+    }
+    sm_decommit( sm );
+    sm_reset( sm );
+    TEST_ASSERT( sm_free_count( sm ) == SLOT_CNT / 4 );
+
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        ptr[ i ] = NULL;
+    }
+    TEST_ASSERT( get_unique( sm, 0, total ) );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+
+    sm_del( sm );
+}
+
+
+void test_idle_decommit( void )
+{
+    sm_t sm;
+    int  i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    TEST_ASSERT( sm_idle( sm ) == 0 );
+
+    /* Free all Tail slots, except the last. */
+    TEST_ASSERT( get_unique( sm, 0, 2 * SLOT_CNT ) );
+    for ( i = SLOT_CNT; i < 2 * SLOT_CNT - 1; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+
+    TEST_ASSERT( sm_set_idle_decommit( sm, 2 ) == 1 );
+
+    /* Activity after setup. */
+    sm_get( sm );
+    TEST_ASSERT( sm_idle( sm ) == 0 );
+    TEST_ASSERT( resident( ptr[ SLOT_CNT + SLOT_CNT / 2 ] ) );
+
+    usleep( 10000 );
+    TEST_ASSERT( sm_idle( sm ) == 1 );
+    TEST_ASSERT( !resident( ptr[ SLOT_CNT + SLOT_CNT / 2 ] ) );
+
+    /* Once per idle period. */
+    usleep( 10000 );
+    TEST_ASSERT( sm_idle( sm ) == 0 );
+
+    sm_get( sm );
+    TEST_ASSERT( sm_idle( sm ) == 0 );
+
+    sm_del( sm );
+}
@@ -0,0 +1,157 @@
+#include "unity.h"
+#include "segman.h"
+#include <pthread.h>
+
+
+/*
+ * Tests:
+ * - deferred (readers block reclamation, mode required)
+ * - deferred threads
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+#define MAGIC    0x5e67a11c
+#define ROUNDS   100000
+
+typedef struct
+{
+    st_id_t magic;
+    st_id_t value;
+} my_node_t;
+typedef my_node_t* my_node_p;
+
+
+sm_t      shared_sm;
+my_node_p shared_node;
+int       reader_stop = 0;
+int       reader_fail = 0;
+int       reader_cnt = 0;
+
+void* reader( void* arg )
+{
+    my_node_p node;
+    st_size_t token;
+
+    arg = arg;
+
+    while ( !__atomic_load_n( &reader_stop, __ATOMIC_ACQUIRE ) ) {
+        token = sm_read_enter( shared_sm );
+        node = __atomic_load_n( &shared_node, __ATOMIC_ACQUIRE );
+        if ( __atomic_load_n( &node->magic, __ATOMIC_RELAXED ) != MAGIC ) {
+            __atomic_add_fetch( &reader_fail, 1, __ATOMIC_RELAXED );
+        }
+        sm_read_exit( shared_sm, token );
+        __atomic_add_fetch( &reader_cnt, 1, __ATOMIC_RELAXED );
+    }
+
+    return NULL;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_deferred( void )
+{
+    sm_t      sm;
+    st_t      slot[ 2 * SLOT_CNT ];
+    st_size_t token;
+    int       i;
+
+    sm = sm_new( 2 * SLOT_CNT, sizeof( my_node_t ) );
+    sm_set_resize_factor( sm, 0 );
+
+    /* Deferred mode is required. */
+    slot[ 0 ] = sm_get( sm );
+    TEST_ASSERT( sm_put_deferred( sm, slot[ 0 ] ) == NULL );
+    TEST_ASSERT( sm_reclaim( sm ) == 0 );
+    sm_put( sm, slot[ 0 ] );
+
+    TEST_ASSERT( sm_set_deferred( sm ) == 1 );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        slot[ i ] = sm_get( sm );
+    }
+
+    token = sm_read_enter( sm );
+
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        sm_put_deferred( sm, slot[ i ] );
+    }
+
+    /* Reader may see the slots. */
+    TEST_ASSERT( sm_reclaim( sm ) == 0 );
+    TEST_ASSERT( sm_reclaim( sm ) == 0 );
+    TEST_ASSERT( sm_get( sm ) == NULL );
+    TEST_ASSERT( sm_used_count( sm ) == 2 * SLOT_CNT );
+
+    sm_read_exit( sm, token );
+
+    /* Out-of-slots reclaims. */
+    TEST_ASSERT( sm_get( sm ) != NULL );
+    TEST_ASSERT( sm_used_count( sm ) == SLOT_CNT + 1 );
+    TEST_ASSERT( sm_free_count( sm ) == SLOT_CNT - 1 );
+
+    /* Reader blocks only slots deferred before or during it. */
+    token = sm_read_enter( sm );
+    sm_put_deferred( sm, slot[ SLOT_CNT ] );
+    TEST_ASSERT( sm_reclaim( sm ) == 0 );
+    sm_read_exit( sm, token );
+    token = sm_read_enter( sm );
+    sm_put_deferred( sm, slot[ SLOT_CNT + 1 ] );
+    TEST_ASSERT( sm_reclaim( sm ) == 1 );
+    sm_read_exit( sm, token );
+    TEST_ASSERT( sm_reclaim( sm ) == 1 );
+
+    TEST_ASSERT( sm_used_count( sm ) == SLOT_CNT - 1 );
+
+    sm_del( sm );
+}
+
+
+void test_deferred_threads( void )
+{
+    pthread_t thread[ 2 ];
+    my_node_p node;
+    my_node_p old;
+    int       i;
+
+    shared_sm = sm_new( 16, sizeof( my_node_t ) );
+    sm_set_deferred( shared_sm );
+
+    shared_node = sm_get( shared_sm );
+    shared_node->magic = MAGIC;
+    shared_node->value = 0;
+
+    for ( i = 0; i < 2; i++ ) {
+        pthread_create( &thread[ i ], NULL, reader, NULL );
+    }
+
+    for ( i = 1; i < ROUNDS; i++ ) {
+        /* Premature re-use would be visible to readers. */
+        node = sm_get( shared_sm );
+        __atomic_store_n( &node->magic, 0, __ATOMIC_SEQ_CST );
+        node->value = i;
+        __atomic_store_n( &node->magic, MAGIC, __ATOMIC_RELAXED );
+        old = __atomic_exchange_n( &shared_node, node, __ATOMIC_ACQ_REL );
+        sm_put_deferred( shared_sm, old );
+    }
+
+    __atomic_store_n( &reader_stop, 1, __ATOMIC_RELEASE );
+
+    for ( i = 0; i < 2; i++ ) {
+        pthread_join( thread[ i ], NULL );
+    }
+
+    TEST_ASSERT( reader_fail == 0 );
+    TEST_ASSERT( reader_cnt > 0 );
+
+    sm_del( shared_sm );
+}
@@ -0,0 +1,221 @@
+#include "unity.h"
+#include "segman.h"
+
+
+/*
+ * Tests:
+ * - steal (splice free slots, limits, mismatch, stolen slots)
+ * - merge (move Tail Segments, refused, runs)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT 16
+
+typedef struct
+{
+    st_t    link;
+    st_id_t id;
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+my_slot_p ptr[ 8 * SLOT_CNT ];
+
+
+/* Number of Segments in Segman. */
+st_size_t seg_count( sm_t sm )
+{
+    sm_tail_t cur;
+    st_size_t cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+/* Slot is within Segments of Segman. */
+int owns( sm_t sm, st_t slot )
+{
+    sm_tail_t cur;
+
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        if ( slot >= cur->base && slot < cur->base + cur->tail_cnt * sm->slot_size ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_steal( void )
+{
+    sm_t      src;
+    sm_t      dst;
+    sm_t      other;
+    my_slot_p slot;
+    int       i;
+
+    src = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    dst = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_resize_factor( dst, 0 );
+
+    /* Only linked slots are moved. */
+    TEST_ASSERT( sm_steal( dst, src, 4 ) == 0 );
+
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( src );
+    }
+    for ( i = 0; i < 3 * SLOT_CNT; i += 2 ) {
+        sm_put( src, ptr[ i ] );
+    }
+    TEST_ASSERT( sm_free_count( src ) >= 3 * SLOT_CNT / 2 );
+
+    /* Exhaust destination. */
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        sm_get( dst );
+    }
+    TEST_ASSERT( sm_get( dst ) == NULL );
+
+    /* Most recently put slots are moved first. */
+    TEST_ASSERT( sm_steal( dst, src, 10 ) == 10 );
+    TEST_ASSERT( sm_free_count( dst ) == 10 );
+    TEST_ASSERT( sm_used_count( src ) == 3 * SLOT_CNT / 2 );
+    for ( i = 0; i < 10; i++ ) {
+        slot = sm_get( dst );
+        TEST_ASSERT( slot == ptr[ 3 * SLOT_CNT - 2 - 2 * i ] );
+        TEST_ASSERT( owns( src, slot ) );
+    }
+    TEST_ASSERT( sm_get( dst ) == NULL );
+
+    /* Source continues from the rest. */
+    slot = sm_get( src );
+    TEST_ASSERT( slot == ptr[ 3 * SLOT_CNT - 22 ] );
+
+    /* Request is limited to linked slots. */
+    i = sm_free_count( src ) - ( src->tail->tail_cnt - src->tail->init_cnt );
+    TEST_ASSERT( sm_steal( dst, src, 1000 ) == (st_size_t)i );
+    TEST_ASSERT( sm_free_count( dst ) == (st_size_t)i );
+    TEST_ASSERT( sm_free_count( src ) == src->tail->tail_cnt - src->tail->init_cnt );
+
+    /* Source still gives its uninitialized slots. */
+    i = sm_free_count( src );
+    while ( i-- > 0 ) {
+        TEST_ASSERT( sm_get( src ) != NULL );
+    }
+
+    /* Slots are put back to destination. */
+    slot = sm_get( dst );
+    TEST_ASSERT( slot != NULL );
+    sm_put( dst, slot );
+    TEST_ASSERT( sm_get( dst ) == slot );
+
+    /* Stolen slots are not within destination Segments. */
+    sm_put( dst, slot );
+    TEST_ASSERT( sm_decommit( dst ) == 0 );
+    TEST_ASSERT( sm_clone( dst, NULL ) == NULL );
+    TEST_ASSERT( sm_get( dst ) == slot );
+
+    sm_reset( dst );
+    TEST_ASSERT( sm_decommit( dst ) == 1 );
+    other = sm_clone( dst, NULL );
+    TEST_ASSERT( other != NULL );
+    sm_del( other );
+
+    /* Slot size mismatch. */
+    other = sm_new( SLOT_CNT, 2 * sizeof( my_slot_t ) );
+    sm_get( other );
+    sm_put( other, sm_get( other ) );
+    TEST_ASSERT( sm_steal( dst, other, 1 ) == 0 );
+    sm_del( other );
+
+    sm_del( dst );
+    sm_del( src );
+}
+
+
+void test_merge( void )
+{
+    sm_t      src;
+    sm_t      dst;
+    sm_t      other;
+    st_t      run;
+    st_size_t seg_cnt;
+    int       i;
+
+    src = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    dst = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( src );
+    }
+    seg_cnt = seg_count( src );
+    TEST_ASSERT( seg_cnt == 4 );
+
+    /* Used slots in source. */
+    TEST_ASSERT( sm_merge( dst, src ) == 0 );
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        sm_put( src, ptr[ i ] );
+    }
+
+    TEST_ASSERT( sm_merge( dst, src ) == 1 );
+    TEST_ASSERT( seg_count( src ) == 1 );
+    TEST_ASSERT( seg_count( dst ) == seg_cnt );
+    TEST_ASSERT( sm_free_count( src ) == SLOT_CNT );
+
+    /* Destination uses moved Segments without allocation. */
+    sm_set_resize_factor( dst, 0 );
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( dst );
+        TEST_ASSERT( ptr[ i ] != NULL );
+        ptr[ i ]->id = i;
+    }
+    TEST_ASSERT( sm_get( dst ) == NULL );
+    TEST_ASSERT( seg_count( dst ) == seg_cnt );
+
+    /* Source grows again by itself. */
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( sm_get( src ) != NULL );
+    }
+    TEST_ASSERT( seg_count( src ) == 2 );
+
+    /* Nothing to move. */
+    other = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_merge( dst, other ) == 1 );
+    TEST_ASSERT( sm_merge( dst, dst ) == 0 );
+    sm_del( other );
+
+    /* Runs are not moved. */
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( src );
+    }
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        sm_put( src, ptr[ i ] );
+    }
+    run = sm_get_run( src, 4 );
+    TEST_ASSERT( run != NULL );
+    TEST_ASSERT( sm_merge( dst, src ) == 0 );
+    sm_put_run( src, run, 4 );
+    TEST_ASSERT( sm_merge( dst, src ) == 0 );
+
+    /* Block size mismatch. */
+    other = sm_new_block( 1024, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_merge( other, src ) == 0 );
+    sm_del( other );
+
+    sm_del( src );
+    sm_del( dst );
+}
@@ -0,0 +1,127 @@
+#include "unity.h"
+#include "segman.h"
+#include <stddef.h>
+
+
+/*
+ * Tests:
+ * - object (ctor, dtor, link offset)
+ * - object reset
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+
+typedef struct
+{
+    st_id_t magic;
+    st_id_t id;
+    st_t    link;
+    char    name[ 16 ];
+} my_obj_t;
+typedef my_obj_t* my_obj_p;
+
+
+int ctor_cnt = 0;
+int dtor_cnt = 0;
+
+void obj_ctor( sm_t sm, st_t slot )
+{
+    sm = sm;
+    ( (my_obj_p)slot )->magic = 0x5e67;
+    ( (my_obj_p)slot )->id = ctor_cnt;
+    ctor_cnt++;
+}
+
+void obj_dtor( sm_t sm, st_t slot )
+{
+    sm = sm;
+    if ( ( (my_obj_p)slot )->magic == 0x5e67 ) {
+        dtor_cnt++;
+    }
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_object( void )
+{
+    sm_t     sm;
+    my_obj_p ptr[ 3 * SLOT_CNT ];
+    st_id_t  i;
+
+    ctor_cnt = 0;
+    dtor_cnt = 0;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_obj_t ) );
+
+    /* Link must fit in slot. */
+    TEST_ASSERT( sm_set_object( sm, obj_ctor, obj_dtor, sizeof( my_obj_t ) ) == 0 );
+    TEST_ASSERT( sm_set_object( sm, obj_ctor, obj_dtor, offsetof( my_obj_t, link ) ) == 1 );
+
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        TEST_ASSERT( ptr[ i ]->magic == 0x5e67 );
+        TEST_ASSERT( ptr[ i ]->id == i );
+    }
+
+    TEST_ASSERT( ctor_cnt == 3 * SLOT_CNT );
+
+    /* Freed objects keep their state. */
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+        TEST_ASSERT( ptr[ i ]->magic == 0x5e67 );
+        TEST_ASSERT( ptr[ i ]->id == ( 3 * SLOT_CNT - 1 - i ) );
+    }
+
+    TEST_ASSERT( ctor_cnt == 3 * SLOT_CNT );
+
+    /* Too late to change mode. */
+    TEST_ASSERT( sm_set_object( sm, obj_ctor, obj_dtor, 0 ) == 0 );
+
+    sm_del( sm );
+    TEST_ASSERT( dtor_cnt == 3 * SLOT_CNT );
+}
+
+
+void test_object_reset( void )
+{
+    sm_t     sm;
+    my_obj_p obj;
+    st_id_t  i;
+
+    ctor_cnt = 0;
+    dtor_cnt = 0;
+
+    sm = sm_new_block( 1024, 128 );
+    sm_set_object( sm, obj_ctor, obj_dtor, offsetof( my_obj_t, link ) );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        sm_get( sm );
+    }
+
+    sm_reset( sm );
+
+    /* Constructed objects are re-used in order, then new ones. */
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        obj = sm_get( sm );
+        TEST_ASSERT( obj->magic == 0x5e67 );
+        TEST_ASSERT( obj->id == i );
+    }
+
+    TEST_ASSERT( ctor_cnt == 4 * SLOT_CNT );
+
+    sm_del( sm );
+    TEST_ASSERT( dtor_cnt == 4 * SLOT_CNT );
+}
@@ -0,0 +1,249 @@
+#include "unity.h"
+#include "segman.h"
+#include <stdio.h>
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - profile (call sites, put, reset, stop)
+ * - profile interval (gets and bytes)
+ * - profile paths (zeroed get, deferred put, call site)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT 1024
+
+typedef struct
+{
+    st_t    link;
+    st_id_t id;
+    char    name[ 48 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+my_slot_p ptr[ 4 * SLOT_CNT ];
+
+
+/* Live slots per site from profile dump (in dump order), return site count. */
+int read_sites( sm_t sm, unsigned long* live, int max )
+{
+    FILE*         fh;
+    char          line[ 1024 ];
+    unsigned long bytes;
+    unsigned long samples;
+    unsigned long total;
+    int           cnt;
+
+    fh = tmpfile();
+    if ( sm_profile_dump( sm, fileno( fh ) ) == 0 ) {
+        fclose( fh );
+        return -1;
+    }
+
+    rewind( fh );
+    cnt = 0;
+    while ( fgets( line, sizeof( line ), fh ) ) {
+        if ( cnt < max
+             && sscanf( line, "live_slots %lu live_bytes %lu samples %lu/%lu", &live[ cnt ], &bytes, &samples, &total )
+                    == 4 ) {
+            cnt++;
+        }
+    }
+
+    fclose( fh );
+
+    return cnt;
+}
+
+
+/* Number of live samples. */
+unsigned long sample_count( sm_t sm )
+{
+    FILE*         fh;
+    unsigned long cnt;
+    char          line[ 1024 ];
+
+    fh = tmpfile();
+    sm_profile_dump( sm, fileno( fh ) );
+    rewind( fh );
+    cnt = 0;
+    if ( fgets( line, sizeof( line ), fh ) ) {
+        sscanf( line, "# slot_size %*u, interval %*u %*s live samples %lu", &cnt );
+    }
+    fclose( fh );
+
+    return cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_profile( void )
+{
+    sm_t          sm;
+    unsigned long live[ 8 ];
+    int           i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    TEST_ASSERT( sm_profile_dump( sm, 1 ) == 0 );
+    TEST_ASSERT( sm_profile_stop( sm ) == 0 );
+    TEST_ASSERT( sm_profile_start( sm, 0, 0 ) == 0 );
+
+    /* Sample all. */
+    TEST_ASSERT( sm_profile_start( sm, 1, 0 ) == 1 );
+    TEST_ASSERT( sm->flags & SM_FLAG_PROFILE );
+
+    /* Two call sites. */
+    for ( i = 0; i < 300; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+    for ( i = 300; i < 400; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 2 );
+    TEST_ASSERT( live[ 0 ] == 300 );
+    TEST_ASSERT( live[ 1 ] == 100 );
+
+    /* Put removes samples, and site order follows live slots. */
+    for ( i = 0; i < 250; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 2 );
+    TEST_ASSERT( live[ 0 ] == 100 );
+    TEST_ASSERT( live[ 1 ] == 50 );
+    TEST_ASSERT( sample_count( sm ) == 150 );
+
+    /* Re-used slots are attributed to the new site. */
+    for ( i = 0; i < 250; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 3 );
+    TEST_ASSERT( live[ 0 ] == 250 );
+    TEST_ASSERT( sample_count( sm ) == 400 );
+
+    for ( i = 0; i < 400; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 0 );
+    TEST_ASSERT( sample_count( sm ) == 0 );
+
+    /* Reset drops samples. */
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+    TEST_ASSERT( sample_count( sm ) == 2 * SLOT_CNT );
+    sm_reset( sm );
+    TEST_ASSERT( sample_count( sm ) == 0 );
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 0 );
+
+    TEST_ASSERT( sm_profile_stop( sm ) == 1 );
+    TEST_ASSERT( !( sm->flags & SM_FLAG_PROFILE ) );
+    TEST_ASSERT( read_sites( sm, live, 8 ) == -1 );
+
+    /* Profiler is released with Segman. */
+    sm_profile_start( sm, 1, 0 );
+    sm_get( sm );
+    sm_del( sm );
+}
+
+
+void test_profile_interval( void )
+{
+    sm_t          sm;
+    unsigned long live[ 8 ];
+    unsigned long cnt;
+    int           i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    /* About one in 100 gets. */
+    TEST_ASSERT( sm_profile_start( sm, 100, 0 ) == 1 );
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+
+    cnt = sample_count( sm );
+    TEST_ASSERT( cnt >= 4 * SLOT_CNT / 200 && cnt <= 4 * SLOT_CNT / 50 );
+
+    /* Estimate is samples times interval. */
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 1 );
+    TEST_ASSERT( live[ 0 ] == cnt * 100 );
+
+    /* About one per 100 slots worth of bytes. */
+    TEST_ASSERT( sm_profile_start( sm, 100 * sizeof( my_slot_t ), SM_PROFILE_BYTES ) == 1 );
+    TEST_ASSERT( sample_count( sm ) == 0 );
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        sm_put( sm, ptr[ i ] );
+        ptr[ i ] = sm_get( sm );
+    }
+
+    cnt = sample_count( sm );
+    TEST_ASSERT( cnt >= 4 * SLOT_CNT / 200 && cnt <= 4 * SLOT_CNT / 50 );
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 1 );
+    TEST_ASSERT( live[ 0 ] == cnt * 100 );
+
+    sm_del( sm );
+}
+
+
+void test_profile_paths( void )
+{
+    sm_t          sm;
+    unsigned long live[ 8 ];
+    int           i;
+
+    /* Zeroed get from cleared slots is sampled. */
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_zeroed( sm, SM_ZERO_IDLE );
+    sm_profile_start( sm, 1, 0 );
+
+    for ( i = 0; i < 100; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+    for ( i = 0; i < 100; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( sample_count( sm ) == 0 );
+    while ( sm_idle( sm ) ) {
+    }
+
+    /* Cleared and other slots are from the same call site. */
+    for ( i = 0; i < 150; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+    }
+    TEST_ASSERT( sample_count( sm ) == 150 );
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 1 );
+    TEST_ASSERT( live[ 0 ] == 150 );
+
+    sm_del( sm );
+
+    /* Reclaimed deferred slots are unsampled. */
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_deferred( sm );
+    sm_profile_start( sm, 1, 0 );
+
+    for ( i = 0; i < SM_DEFER_BATCH_CNT - 1; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+    for ( i = 0; i < SM_DEFER_BATCH_CNT - 1; i++ ) {
+        sm_put_deferred( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( sample_count( sm ) == SM_DEFER_BATCH_CNT - 1 );
+    TEST_ASSERT( sm_reclaim( sm ) == SM_DEFER_BATCH_CNT - 1 );
+    TEST_ASSERT( sample_count( sm ) == 0 );
+    TEST_ASSERT( read_sites( sm, live, 8 ) == 0 );
+
+    sm_del( sm );
+}
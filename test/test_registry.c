@@ -0,0 +1,98 @@
+#include "unity.h"
+#include "segman.h"
+#include <stdio.h>
+#include <string.h>
+
+
+/*
+ * Tests:
+ * - registry (text, json, released Segments)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+
+
+char dump_buf[ 4096 ];
+
+char* dump( st_size_t format )
+{
+    FILE*  fh;
+    size_t len;
+
+    fh = tmpfile();
+    sm_registry_dump( fileno( fh ), format );
+    rewind( fh );
+    len = fread( dump_buf, 1, sizeof( dump_buf ) - 1, fh );
+    dump_buf[ len ] = 0;
+    fclose( fh );
+
+    return dump_buf;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_registry( void )
+{
+    sm_t sm1;
+    sm_t sm2;
+    sm_t sm3;
+
+    /* Not registered. */
+    sm3 = sm_new( SLOT_CNT, 32 );
+
+    sm_registry_enable( 1 );
+
+    sm1 = sm_new( SLOT_CNT, 32 );
+    sm2 = sm_new_block( 1024, 128 );
+    sm_set_name( sm1, "sessions" );
+    sm_set_name( sm2, "q\"uote" );
+    sm_set_name( sm3, "other" );
+
+    sm_get( sm1 );
+    sm_get( sm1 );
+
+    dump( SM_DUMP_TEXT );
+    TEST_ASSERT( strstr( dump_buf, "segman_slot_size{pool=\"sessions\"} 32\n" ) );
+    TEST_ASSERT( strstr( dump_buf, "segman_used_count{pool=\"sessions\"} 2\n" ) );
+    TEST_ASSERT( strstr( dump_buf, "segman_free_count{pool=\"sessions\"} 2\n" ) );
+    TEST_ASSERT( strstr( dump_buf, "segman_segment_count{pool=\"q\\\"uote\"} 1\n" ) );
+    TEST_ASSERT( strstr( dump_buf, "segman_bytes{pool=\"q\\\"uote\"} 1024\n" ) );
+    TEST_ASSERT( strstr( dump_buf, "other" ) );
+
+    sm_del( sm3 );
+
+    /* Grow by one Segment. */
+    sm_get( sm1 );
+    sm_get( sm1 );
+    sm_get( sm1 );
+
+    dump( SM_DUMP_JSON );
+    TEST_ASSERT( strncmp( dump_buf, "{\"pools\":[{", 11 ) == 0 );
+    TEST_ASSERT( strstr( dump_buf,
+                         "{\"name\":\"sessions\",\"slot_size\":32,\"total\":8,\"used\":5,"
+                         "\"free\":3,\"segments\":2," ) );
+    TEST_ASSERT( strstr( dump_buf, "\"name\":\"q\\\"uote\"" ) );
+    TEST_ASSERT( strstr( dump_buf, "other" ) == NULL );
+
+    /* Released Segments are not counted. */
+    sm_reset( sm1 );
+    TEST_ASSERT( sm_trim( sm1 ) > 0 );
+    dump( SM_DUMP_TEXT );
+    TEST_ASSERT( strstr( dump_buf, "segman_segment_count{pool=\"sessions\"} 1\n" ) );
+
+    sm_del( sm1 );
+    sm_del( sm2 );
+    sm_registry_enable( 0 );
+
+    dump( SM_DUMP_JSON );
+    TEST_ASSERT( strcmp( dump_buf, "{\"pools\":[]}\n" ) == 0 );
+}
@@ -0,0 +1,219 @@
+#include "unity.h"
+#include "segman.h"
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - reserve (fixed, prefault)
+ * - reserve single Segment
+ * - reserve block
+ * - low-water mark (maintain, thread)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+
+typedef struct
+{
+    union
+    {
+        st_t    ptr;
+        st_id_t id;
+    };
+    char name[ 24 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+int seg_cnt( sm_t sm )
+{
+    sm_tail_t cur;
+    int       cnt;
+
+    cnt = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_reserve( void )
+{
+    sm_t      sm;
+    st_t      slot;
+    st_id_t   i;
+    st_size_t slot_size = sizeof( my_slot_t );
+
+    sm = sm_new( SLOT_CNT, slot_size );
+
+    /* Host is enough. */
+    TEST_ASSERT( sm_reserve( sm, SLOT_CNT, 0 ) == 1 );
+    TEST_ASSERT( seg_cnt( sm ) == 1 );
+
+    TEST_ASSERT(
+        sm_reserve( sm, 4 * SLOT_CNT, SM_RESERVE_PREFAULT | SM_RESERVE_FIXED ) == 1 );
+    TEST_ASSERT( seg_cnt( sm ) == 4 );
+    TEST_ASSERT( sm->flags & SM_FLAG_FIXED );
+
+    /* Reserved Segments are not counted before use. */
+    TEST_ASSERT( sm_total_count( sm ) == SLOT_CNT );
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        slot = sm_get( sm );
+        TEST_ASSERT( slot != NULL );
+        ( (my_slot_p)slot )->id = i;
+    }
+
+    TEST_ASSERT( sm_used_count( sm ) == 4 * SLOT_CNT );
+    TEST_ASSERT( sm_free_count( sm ) == 0 );
+
+    /* Fixed: no more allocation. */
+    slot = sm_get( sm );
+    TEST_ASSERT( slot == NULL );
+    TEST_ASSERT( seg_cnt( sm ) == 4 );
+
+    /* Reserved Segments are re-used after reset. */
+    sm_reset( sm );
+    TEST_ASSERT( sm_reserve( sm, 4 * SLOT_CNT, 0 ) == 1 );
+    TEST_ASSERT( seg_cnt( sm ) == 4 );
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+    TEST_ASSERT( sm_get( sm ) == NULL );
+
+    sm_del( sm );
+}
+
+
+void test_reserve_single( void )
+{
+    sm_t    sm;
+    st_id_t i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    /* One Segment for the missing slots, resize factor is kept. */
+    TEST_ASSERT( sm_reserve( sm, 5 * SLOT_CNT, SM_RESERVE_SINGLE ) == 1 );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+    TEST_ASSERT( sm->host.next->tail_cnt == 4 * SLOT_CNT );
+    TEST_ASSERT( sm->resize == 100 );
+
+    for ( i = 0; i < 5 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+
+    /* Segment is not smaller than with resize factor. */
+    TEST_ASSERT( sm_reserve( sm, sm_free_count( sm ) + 1, SM_RESERVE_SINGLE ) == 1 );
+    TEST_ASSERT( sm->host.next->next->tail_cnt == SLOT_CNT );
+
+    sm_del( sm );
+}
+
+
+void test_reserve_block( void )
+{
+    sm_t      sm;
+    st_id_t   i;
+    st_size_t slot_cnt;
+
+    sm = sm_new_block( 1024, 128 );
+    sm_set_resize_factor( sm, 0 );
+
+    slot_cnt = sm_total_count( sm );
+
+    /* Resize factor 0 does not prevent reservation. */
+    TEST_ASSERT( sm_reserve( sm, slot_cnt + 1, SM_RESERVE_PREFAULT ) == 1 );
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+
+    for ( i = 0; i < (st_id_t)slot_cnt + 1; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+
+    TEST_ASSERT( sm_total_count( sm ) > slot_cnt );
+
+    sm_del( sm );
+}
+
+
+void test_low_water( void )
+{
+    sm_t    sm;
+    st_id_t i;
+
+    sm = sm_new( 2 * SLOT_CNT, sizeof( my_slot_t ) );
+    sm_reserve( sm, 0, SM_RESERVE_FIXED );
+
+    TEST_ASSERT( sm_set_low_water( sm, SLOT_CNT ) == 1 );
+    TEST_ASSERT( sm_spare_count( sm ) == 0 );
+
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+
+    /* At the mark, nothing requested yet. */
+    TEST_ASSERT( sm_maintain( sm ) == 1 );
+    TEST_ASSERT( sm_spare_count( sm ) == 0 );
+
+    TEST_ASSERT( sm_get( sm ) != NULL );
+    TEST_ASSERT( sm_maintain( sm ) == 1 );
+    TEST_ASSERT( sm_spare_count( sm ) == 2 * SLOT_CNT );
+    TEST_ASSERT( seg_cnt( sm ) == 1 );
+
+    /* Fixed mode, but provisioned Segment is used. */
+    for ( i = SLOT_CNT + 1; i < 4 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+    TEST_ASSERT( seg_cnt( sm ) == 2 );
+    TEST_ASSERT( sm_free_count( sm ) == 0 );
+    TEST_ASSERT( sm_get( sm ) == NULL );
+
+    /* Spare is released with Segman. */
+    TEST_ASSERT( sm_maintain( sm ) == 1 );
+    TEST_ASSERT( sm_spare_count( sm ) == 2 * SLOT_CNT );
+
+    sm_del( sm );
+}
+
+
+void test_provision( void )
+{
+    sm_t    sm;
+    st_id_t i;
+    int     wait;
+
+    sm = sm_new( 2 * SLOT_CNT, sizeof( my_slot_t ) );
+    sm_reserve( sm, 0, SM_RESERVE_FIXED );
+    sm_set_low_water( sm, SLOT_CNT );
+    TEST_ASSERT( sm_provision_start( sm ) == 1 );
+
+    for ( i = 0; i < 20 * SLOT_CNT; i++ ) {
+
+        if ( sm_free_count( sm ) == 0 ) {
+            /* Let the thread catch up. */
+            for ( wait = 0; wait < 1000 && sm_spare_count( sm ) == 0; wait++ ) {
+                usleep( 1000 );
+            }
+        }
+
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+
+    sm_provision_stop( sm );
+    TEST_ASSERT( sm_used_count( sm ) == 20 * SLOT_CNT );
+
+    sm_del( sm );
+}
@@ -0,0 +1,160 @@
+#include "unity.h"
+#include "segman.h"
+
+
+/*
+ * Tests:
+ * - run (get, put, fit, invalid put)
+ * - run mixed with single slots
+ * - run larger than Segment
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_SIZE 16
+
+
+int run_free( st_t* run, int cnt, st_t slot )
+{
+    int i;
+
+    for ( i = 0; i < cnt; i++ ) {
+        if ( run[ i ] == slot ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_run( void )
+{
+    sm_t sm;
+    st_t run[ 8 ];
+    st_t base;
+    int  i;
+
+    /* 100 slots per Segment, i.e. bitmap of two words. */
+    sm = sm_new( 100, SLOT_SIZE );
+
+    TEST_ASSERT( sm_get_run( sm, 0 ) == NULL );
+    TEST_ASSERT( sm_get_run( sm, SM_RUN_MAX + 1 ) == NULL );
+
+    base = sm_get_run( sm, 1 );
+    TEST_ASSERT( base != NULL );
+
+    /* Runs are packed. */
+    run[ 0 ] = sm_get_run( sm, 10 );
+    TEST_ASSERT( run[ 0 ] == base + SLOT_SIZE );
+    run[ 1 ] = sm_get_run( sm, 60 );
+    TEST_ASSERT( run[ 1 ] == base + 11 * SLOT_SIZE );
+
+    /* Crosses bitmap word. */
+    run[ 2 ] = sm_get_run( sm, 16 );
+    TEST_ASSERT( run[ 2 ] == base + 71 * SLOT_SIZE );
+
+    /* Remaining 13 slots are not enough. */
+    run[ 3 ] = sm_get_run( sm, 16 );
+    TEST_ASSERT( run[ 3 ] != NULL );
+    TEST_ASSERT( run[ 3 ] < base || run[ 3 ] >= base + 100 * SLOT_SIZE );
+
+    /* Hole fits. */
+    TEST_ASSERT( sm_put_run( sm, run[ 0 ], 10 ) == sm );
+    run[ 4 ] = sm_get_run( sm, 13 );
+    TEST_ASSERT( run[ 4 ] == base + 87 * SLOT_SIZE );
+    run[ 5 ] = sm_get_run( sm, 10 );
+    TEST_ASSERT( run[ 5 ] == base + SLOT_SIZE );
+
+    /* Runs are not counted as slots. */
+    TEST_ASSERT( sm_used_count( sm ) == 0 );
+
+    TEST_ASSERT( sm_put_run( sm, &i, 1 ) == NULL );
+
+    /* Double, overlapping and misaligned put. */
+    TEST_ASSERT( sm_put_run( sm, run[ 5 ], 10 ) == sm );
+    TEST_ASSERT( sm_put_run( sm, run[ 5 ], 10 ) == NULL );
+    TEST_ASSERT( sm_put_run( sm, run[ 4 ], 14 ) == NULL );
+    TEST_ASSERT( sm_put_run( sm, run[ 4 ] + 1, 1 ) == NULL );
+    TEST_ASSERT( sm_put_run( sm, run[ 4 ], 0 ) == NULL );
+    TEST_ASSERT( sm_put_run( sm, run[ 4 ], 13 ) == sm );
+    run[ 5 ] = sm_get_run( sm, 10 );
+    TEST_ASSERT( run[ 5 ] == base + SLOT_SIZE );
+
+    /* Reset frees runs. */
+    sm_reset( sm );
+    TEST_ASSERT( sm_get_run( sm, 64 ) == base );
+
+    sm_del( sm );
+}
+
+
+void test_run_mixed( void )
+{
+    sm_t sm;
+    st_t slot[ 40 ];
+    st_t run[ 10 ];
+    int  i;
+    int  j;
+
+    sm = sm_new( 16, SLOT_SIZE );
+    sm_set_resize_factor( sm, 200 );
+
+    for ( i = 0; i < 10; i++ ) {
+        slot[ i ] = sm_get( sm );
+        run[ i ] = sm_get_run( sm, 3 );
+        TEST_ASSERT( run[ i ] != NULL );
+        slot[ i + 10 ] = sm_get( sm );
+    }
+
+    /* Single slots are never within runs. */
+    for ( i = 0; i < 20; i++ ) {
+        for ( j = 0; j < 10; j++ ) {
+            TEST_ASSERT( slot[ i ] < run[ j ] || slot[ i ] >= run[ j ] + 3 * SLOT_SIZE );
+        }
+        TEST_ASSERT( run_free( run, 10, slot[ i ] ) );
+    }
+
+    for ( i = 0; i < 10; i++ ) {
+        TEST_ASSERT( sm_put_run( sm, run[ i ], 3 ) == sm );
+        sm_put( sm, slot[ i ] );
+        sm_put( sm, slot[ i + 10 ] );
+    }
+
+    TEST_ASSERT( sm_used_count( sm ) == 0 );
+
+    sm_del( sm );
+}
+
+
+void test_run_oversize( void )
+{
+    sm_t        sm;
+    sm_budget_t bg;
+    st_size_t   used;
+
+    /* 16 slots per Segment. */
+    sm = sm_new( 16, SLOT_SIZE );
+    bg = sm_budget_new( 1 << 20, 0 );
+    sm_set_budget( sm, bg );
+    used = sm_budget_used( bg );
+
+    /* No Segment is allocated for a run that does not fit. */
+    TEST_ASSERT( sm_get_run( sm, 17 ) == NULL );
+    TEST_ASSERT( sm_get_run( sm, 17 ) == NULL );
+    TEST_ASSERT( sm_budget_used( bg ) == used );
+
+    TEST_ASSERT( sm_get_run( sm, 16 ) != NULL );
+    TEST_ASSERT( sm_budget_used( bg ) > used );
+
+    sm_del( sm );
+    sm_budget_del( bg );
+}
@@ -0,0 +1,258 @@
+#include "unity.h"
+#include "segman.h"
+#include <stdio.h>
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - trace (get, put, grow, translation)
+ * - trace flush (buffer full, multiple chunks)
+ * - trace trim (stable Segment numbers, clock unit)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+
+typedef struct
+{
+    union
+    {
+        st_t    ptr;
+        st_id_t id;
+    };
+    char name[ 24 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+/* Read next chunk (header and events) from trace file. */
+int read_chunk( FILE* fh, sm_trace_hdr_s* hdr, sm_trace_ev_s* ev, int max )
+{
+    if ( fread( hdr, sizeof( sm_trace_hdr_s ), 1, fh ) != 1 ) {
+        return -1;
+    }
+
+    if ( hdr->magic != SM_TRACE_MAGIC || (int)hdr->ev_cnt > max ) {
+        return -1;
+    }
+
+    return fread( ev, sizeof( sm_trace_ev_s ), hdr->ev_cnt, fh );
+}
+
+
+/* Segment number and slot index of slot. */
+void slot_ref( sm_t sm, st_t slot, uint32_t* seg, uint32_t* index )
+{
+    sm_tail_t cur;
+    uint32_t  num;
+
+    num = 0;
+    for ( cur = &sm->host; cur; cur = cur->next ) {
+        if ( slot >= cur->base && slot < cur->base + cur->tail_cnt * sm->slot_size ) {
+            *seg = num;
+            *index = ( slot - cur->base ) / sm->slot_size;
+            return;
+        }
+        num++;
+    }
+
+    *seg = UINT32_MAX;
+    *index = UINT32_MAX;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_trace( void )
+{
+    sm_t           sm;
+    FILE*          fh;
+    my_slot_p      ptr[ 2 * SLOT_CNT ];
+    sm_trace_hdr_s hdr;
+    sm_trace_ev_s  ev[ 64 ];
+    uint32_t       seg;
+    uint32_t       index;
+    uint64_t       time;
+    int            cnt;
+    int            i;
+    int            e;
+
+    fh = tmpfile();
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    TEST_ASSERT( sm_trace_flush( sm ) == 0 );
+    TEST_ASSERT( sm_trace_start( sm, 0, fileno( fh ) ) == 0 );
+    TEST_ASSERT( sm_trace_start( sm, 64, fileno( fh ) ) == 1 );
+    TEST_ASSERT( sm->flags & SM_FLAG_TRACE );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+
+    sm_put( sm, ptr[ 1 ] );
+    sm_put( sm, ptr[ SLOT_CNT ] );
+
+    /* Failed put is not recorded. */
+    sm_reset( sm );
+    sm_put( sm, ptr[ 0 ] );
+
+    TEST_ASSERT( sm_trace_stop( sm ) == 1 );
+    TEST_ASSERT( !( sm->flags & SM_FLAG_TRACE ) );
+
+    rewind( fh );
+    cnt = read_chunk( fh, &hdr, ev, 64 );
+    TEST_ASSERT( read_chunk( fh, &hdr, ev, 64 ) == -1 );
+
+    rewind( fh );
+    TEST_ASSERT( read_chunk( fh, &hdr, ev, 64 ) == 2 * SLOT_CNT + 1 + 2 );
+    TEST_ASSERT( cnt == 2 * SLOT_CNT + 1 + 2 );
+    TEST_ASSERT( hdr.slot_size == sizeof( my_slot_t ) );
+
+    /* Host slots, grow, tail slots, and puts. */
+    e = 0;
+    time = 0;
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        if ( i == SLOT_CNT ) {
+            TEST_ASSERT( SM_TRACE_TYPE( &ev[ e ] ) == SM_TRACE_GROW );
+            TEST_ASSERT( ev[ e ].seg == 1 && ev[ e ].index == 0 );
+            e++;
+        }
+        slot_ref( sm, ptr[ i ], &seg, &index );
+        TEST_ASSERT( SM_TRACE_TYPE( &ev[ e ] ) == SM_TRACE_GET );
+        TEST_ASSERT( SM_TRACE_TIME( &ev[ e ] ) >= time );
+        TEST_ASSERT( ev[ e ].seg == seg );
+        TEST_ASSERT( ev[ e ].index == index );
+        TEST_ASSERT( seg == (uint32_t)( i / SLOT_CNT ) );
+        time = SM_TRACE_TIME( &ev[ e ] );
+        e++;
+    }
+
+    TEST_ASSERT( SM_TRACE_TYPE( &ev[ e ] ) == SM_TRACE_PUT );
+    TEST_ASSERT( ev[ e ].seg == 0 && ev[ e ].index == 1 );
+    e++;
+    TEST_ASSERT( SM_TRACE_TYPE( &ev[ e ] ) == SM_TRACE_PUT );
+    TEST_ASSERT( ev[ e ].seg == 1 && ev[ e ].index == 0 );
+
+    fclose( fh );
+    sm_del( sm );
+}
+
+
+void test_trace_flush( void )
+{
+    sm_t           sm;
+    FILE*          fh;
+    st_t           slot;
+    sm_trace_hdr_s hdr;
+    sm_trace_ev_s  ev[ 8 ];
+    int            cnt;
+    int            chunk;
+    int            i;
+
+    fh = tmpfile();
+    sm = sm_new( 64, sizeof( my_slot_t ) );
+    sm_trace_start( sm, 8, fileno( fh ) );
+
+    for ( i = 0; i < 10; i++ ) {
+        slot = sm_get( sm );
+        sm_put( sm, slot );
+    }
+
+    /* Two full buffers written. */
+    TEST_ASSERT( ftell( fh ) == 2 * (long)( sizeof( hdr ) + 8 * sizeof( sm_trace_ev_s ) ) );
+
+    TEST_ASSERT( sm_trace_flush( sm ) == 1 );
+    TEST_ASSERT( sm_trace_flush( sm ) == 1 );
+
+    /* Remaining events are written at delete. */
+    sm_get( sm );
+    sm_del( sm );
+
+    rewind( fh );
+    chunk = 0;
+    cnt = 0;
+    while ( ( i = read_chunk( fh, &hdr, ev, 8 ) ) >= 0 ) {
+        TEST_ASSERT( SM_TRACE_TYPE( &ev[ 0 ] ) == SM_TRACE_GET );
+        TEST_ASSERT( ev[ 0 ].seg == 0 && ev[ 0 ].index == 0 );
+        cnt += i;
+        chunk++;
+    }
+
+    TEST_ASSERT( chunk == 4 );
+    TEST_ASSERT( cnt == 21 );
+
+    fclose( fh );
+}
+
+
+void test_trace_trim( void )
+{
+    sm_t           sm;
+    FILE*          fh;
+    my_slot_p      ptr[ 3 * SLOT_CNT ];
+    my_slot_p      slot;
+    sm_trace_hdr_s hdr;
+    sm_trace_ev_s  ev[ 256 ];
+    int            cnt;
+    int            i;
+
+    fh = tmpfile();
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    sm_set_resize_factor( sm, 100 );
+    sm_trace_start( sm, 256, fileno( fh ) );
+
+    /* Host and two Tails. */
+    for ( i = 0; i < 3 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+
+    /* Middle Segment is released. Buffered events are written first. */
+    for ( i = SLOT_CNT; i < 2 * SLOT_CNT; i++ ) {
+        sm_put( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( sm_trim( sm ) > 0 );
+    TEST_ASSERT( ftell( fh ) > 0 );
+
+    /* Last Segment keeps its number. */
+    sm_put( sm, ptr[ 3 * SLOT_CNT - 1 ] );
+    slot = sm_get( sm );
+    TEST_ASSERT( slot == ptr[ 3 * SLOT_CNT - 1 ] );
+
+    /* New Segment gets a new number. */
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        slot = sm_get( sm );
+    }
+    TEST_ASSERT( sm_trace_stop( sm ) == 1 );
+
+    rewind( fh );
+    TEST_ASSERT( read_chunk( fh, &hdr, ev, 256 ) == 3 * SLOT_CNT + 2 + SLOT_CNT );
+#if defined( __x86_64__ ) || defined( __i386__ )
+    TEST_ASSERT( hdr.clock == SM_TRACE_CLOCK_TSC );
+#else
+    TEST_ASSERT( hdr.clock == SM_TRACE_CLOCK_NS );
+#endif
+    TEST_ASSERT( ev[ SLOT_CNT + 1 ].seg == 1 );
+    TEST_ASSERT( ev[ 3 * SLOT_CNT + 1 ].seg == 2 );
+    TEST_ASSERT( ev[ 4 * SLOT_CNT + 1 ].seg == 1 );
+
+    cnt = read_chunk( fh, &hdr, ev, 256 );
+    TEST_ASSERT( cnt == 2 + SLOT_CNT + 1 );
+    TEST_ASSERT( SM_TRACE_TYPE( &ev[ 0 ] ) == SM_TRACE_PUT );
+    TEST_ASSERT( ev[ 0 ].seg == 2 && ev[ 0 ].index == SLOT_CNT - 1 );
+    TEST_ASSERT( SM_TRACE_TYPE( &ev[ 1 ] ) == SM_TRACE_GET );
+    TEST_ASSERT( ev[ 1 ].seg == 2 && ev[ 1 ].index == SLOT_CNT - 1 );
+    TEST_ASSERT( SM_TRACE_TYPE( &ev[ 2 ] ) == SM_TRACE_GROW );
+    TEST_ASSERT( ev[ 2 ].seg == 3 && ev[ 2 ].index == 0 );
+    TEST_ASSERT( ev[ cnt - 1 ].seg == 3 );
+
+    fclose( fh );
+    sm_del( sm );
+}
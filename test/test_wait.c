@@ -0,0 +1,278 @@
+#include "unity.h"
+#include "segman.h"
+#include <pthread.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+ * Tests:
+ * - get wait (release by another thread, timeout)
+ * - get wait with several waiters
+ * - wait fd
+ * - wait fd with other slot sources (reset, reserve, reclaim, steal, merge)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT   16
+#define WAITER_CNT 4
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+sm_t            pool;
+st_t            ptr[ SLOT_CNT ];
+st_t            got[ WAITER_CNT ];
+
+
+uint64_t now_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Exhaust pool. */
+void get_all( sm_t sm )
+{
+    int i;
+
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get( sm );
+    }
+}
+
+
+/* Release one slot after a delay. */
+void* releaser( void* arg )
+{
+    arg = arg;
+
+    usleep( 50000 );
+    pthread_mutex_lock( &lock );
+    sm_put( pool, ptr[ 0 ] );
+    pthread_mutex_unlock( &lock );
+
+    return NULL;
+}
+
+
+/* Wait for slot. */
+void* waiter( void* arg )
+{
+    pthread_mutex_lock( &lock );
+    got[ (intptr_t)arg ] = sm_get_wait( pool, SM_WAIT_INF, &lock );
+    pthread_mutex_unlock( &lock );
+
+    return NULL;
+}
+
+
+int readable( int fd )
+{
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    return poll( &pfd, 1, 0 ) == 1;
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_get_wait( void )
+{
+    pthread_t thread;
+    uint64_t  start;
+    st_t      slot;
+
+    pool = sm_new( SLOT_CNT, sizeof( st_t ) );
+    sm_set_resize_factor( pool, 0 );
+
+    get_all( pool );
+    TEST_ASSERT( sm_get( pool ) == NULL );
+
+    /* No waiting without timeout or lock. */
+    TEST_ASSERT( sm_get_wait( pool, 0, &lock ) == NULL );
+    TEST_ASSERT( sm_get_wait( pool, 1000, NULL ) == NULL );
+
+    /* Slot released by another thread. */
+    pthread_mutex_lock( &lock );
+    pthread_create( &thread, NULL, releaser, NULL );
+    slot = sm_get_wait( pool, 5000, &lock );
+    pthread_mutex_unlock( &lock );
+    pthread_join( thread, NULL );
+    TEST_ASSERT( slot == ptr[ 0 ] );
+
+    /* Timeout. */
+    pthread_mutex_lock( &lock );
+    start = now_ms();
+    TEST_ASSERT( sm_get_wait( pool, 50, &lock ) == NULL );
+    TEST_ASSERT( now_ms() - start >= 45 );
+    pthread_mutex_unlock( &lock );
+
+    /* Available slot is returned without waiting. */
+    sm_put( pool, slot );
+    TEST_ASSERT( sm_get_wait( pool, SM_WAIT_INF, &lock ) == slot );
+
+    sm_del( pool );
+}
+
+
+void test_get_wait_many( void )
+{
+    pthread_t thread[ WAITER_CNT ];
+    intptr_t  i;
+    int       j;
+
+    pool = sm_new( SLOT_CNT, sizeof( st_t ) );
+    sm_set_resize_factor( pool, 0 );
+    get_all( pool );
+
+    for ( i = 0; i < WAITER_CNT; i++ ) {
+        got[ i ] = NULL;
+        pthread_create( &thread[ i ], NULL, waiter, (st_t)i );
+    }
+
+    /* Let all waiters block. */
+    usleep( 50000 );
+
+    /* Only the first put wakes, wakeup is passed on. */
+    pthread_mutex_lock( &lock );
+    for ( i = 0; i < WAITER_CNT; i++ ) {
+        sm_put( pool, ptr[ i ] );
+    }
+    pthread_mutex_unlock( &lock );
+
+    for ( i = 0; i < WAITER_CNT; i++ ) {
+        pthread_join( thread[ i ], NULL );
+    }
+
+    for ( i = 0; i < WAITER_CNT; i++ ) {
+        TEST_ASSERT( got[ i ] != NULL );
+        for ( j = 0; j < i; j++ ) {
+            TEST_ASSERT( got[ i ] != got[ j ] );
+        }
+    }
+    TEST_ASSERT( sm_used_count( pool ) == SLOT_CNT );
+
+    sm_del( pool );
+}
+
+
+void test_wait_fd( void )
+{
+    sm_t     sm;
+    int      fd;
+    uint64_t cnt;
+
+    sm = sm_new( SLOT_CNT, sizeof( st_t ) );
+    sm_set_resize_factor( sm, 0 );
+
+    fd = sm_wait_fd( sm );
+    TEST_ASSERT( fd >= 0 );
+    TEST_ASSERT( sm_wait_fd( sm ) == fd );
+    TEST_ASSERT( !readable( fd ) );
+
+    /* Put to non-empty pool does not notify. */
+    get_all( sm );
+    sm_put( sm, ptr[ 0 ] );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( read( fd, &cnt, sizeof( cnt ) ) == sizeof( cnt ) );
+    TEST_ASSERT( cnt == 1 );
+    sm_put( sm, ptr[ 1 ] );
+    TEST_ASSERT( !readable( fd ) );
+
+    /* Exhausted again. */
+    TEST_ASSERT( sm_get( sm ) == ptr[ 1 ] );
+    TEST_ASSERT( sm_get( sm ) == ptr[ 0 ] );
+    TEST_ASSERT( sm_get( sm ) == NULL );
+    TEST_ASSERT( !readable( fd ) );
+    sm_put( sm, ptr[ 0 ] );
+    TEST_ASSERT( readable( fd ) );
+
+    sm_del( sm );
+}
+
+
+void test_wait_fd_sources( void )
+{
+    sm_t     sm;
+    sm_t     other;
+    int      fd;
+    uint64_t cnt;
+    int      i;
+
+    sm = sm_new( SLOT_CNT, sizeof( st_t ) );
+    sm_set_resize_factor( sm, 0 );
+    fd = sm_wait_fd( sm );
+
+    /* Reset. */
+    get_all( sm );
+    TEST_ASSERT( sm_get( sm ) == NULL );
+    sm_reset( sm );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( read( fd, &cnt, sizeof( cnt ) ) == sizeof( cnt ) );
+    sm_reset( sm );
+    TEST_ASSERT( !readable( fd ) );
+
+    /* Reserve. */
+    get_all( sm );
+    TEST_ASSERT( sm_reserve( sm, 2 * SLOT_CNT, 0 ) == 1 );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( read( fd, &cnt, sizeof( cnt ) ) == sizeof( cnt ) );
+    TEST_ASSERT( cnt == 1 );
+    get_all( sm );
+    while ( sm_get( sm ) ) {
+    }
+
+    /* Reclaim of deferred slots. */
+    TEST_ASSERT( sm_set_deferred( sm ) == 1 );
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        sm_put_deferred( sm, ptr[ i ] );
+    }
+    TEST_ASSERT( !readable( fd ) );
+    TEST_ASSERT( sm_reclaim( sm ) == SLOT_CNT );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( read( fd, &cnt, sizeof( cnt ) ) == sizeof( cnt ) );
+    sm_del( sm );
+
+    /* Steal and merge. */
+    sm = sm_new( SLOT_CNT, sizeof( st_t ) );
+    sm_set_resize_factor( sm, 0 );
+    fd = sm_wait_fd( sm );
+    other = sm_new( SLOT_CNT, sizeof( st_t ) );
+
+    get_all( sm );
+    get_all( other );
+    for ( i = 0; i < SLOT_CNT; i++ ) {
+        sm_put( other, ptr[ i ] );
+    }
+    TEST_ASSERT( sm_steal( sm, other, 1 ) == 1 );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( read( fd, &cnt, sizeof( cnt ) ) == sizeof( cnt ) );
+    TEST_ASSERT( sm_get( sm ) != NULL );
+    TEST_ASSERT( sm_get( sm ) == NULL );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        sm_get( other );
+    }
+    sm_reset( other );
+    TEST_ASSERT( sm_merge( sm, other ) == 1 );
+    TEST_ASSERT( readable( fd ) );
+    TEST_ASSERT( sm_get( sm ) != NULL );
+
+    sm_del( other );
+    sm_del( sm );
+}
@@ -0,0 +1,223 @@
+#include "unity.h"
+#include "segman.h"
+#include <string.h>
+
+
+/*
+ * Tests:
+ * - zeroed (plain Segman)
+ * - zeroed mode (fresh and recycled slots, reset, setup)
+ * - zeroed mixed (plain and zeroed gets)
+ * - zeroed idle (slots cleared in idle time)
+ */
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+#define SLOT_CNT SM_MIN_SLOT_CNT
+
+typedef struct
+{
+    st_t    link;
+    st_id_t id;
+    char    name[ 48 ];
+} my_slot_t;
+typedef my_slot_t* my_slot_p;
+
+
+/* Slot is all zeros. */
+int is_zero( st_t slot, st_size_t size )
+{
+    st_size_t i;
+
+    for ( i = 0; i < size; i++ ) {
+        if ( ( (char*)slot )[ i ] ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Fill slot with garbage and put it back. */
+void put_dirty( sm_t sm, my_slot_p slot )
+{
+    memset( slot, 0xa5, sizeof( my_slot_t ) );
+    sm_put( sm, slot );
+}
+
+
+
+/* ------------------------------------------------------------
+ * Tests:
+ */
+
+void test_zeroed( void )
+{
+    sm_t      sm;
+    my_slot_p ptr[ 2 * SLOT_CNT ];
+    int       i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+    }
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        put_dirty( sm, ptr[ i ] );
+    }
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+    }
+
+    TEST_ASSERT( sm_used_count( sm ) == 2 * SLOT_CNT );
+
+    sm_del( sm );
+}
+
+
+void test_zeroed_mode( void )
+{
+    sm_t      sm;
+    my_slot_p ptr[ 4 * SLOT_CNT ];
+    int       i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_set_zeroed( sm, 0 ) == 1 );
+    TEST_ASSERT( sm->flags & SM_FLAG_ZERO );
+
+    /* Object mode is exclusive. */
+    TEST_ASSERT( sm_set_object( sm, NULL, NULL, 0 ) == 0 );
+
+    /* Fresh slots from calloc'd tails. */
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+        ptr[ i ]->id = i + 1;
+    }
+
+    /* Recycled slots are cleared. */
+    for ( i = 0; i < 4 * SLOT_CNT; i += 2 ) {
+        put_dirty( sm, ptr[ i ] );
+    }
+    for ( i = 0; i < 4 * SLOT_CNT; i += 2 ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+        ptr[ i ]->id = i + 1;
+    }
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( ptr[ i ]->id == (st_id_t)( i + 1 ) );
+    }
+
+    /* Reset re-uses dirty Segments. */
+    sm_reset( sm );
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+    }
+
+    /* Setup fails after tails are allocated. */
+    TEST_ASSERT( sm_set_zeroed( sm, SM_ZERO_IDLE ) == 0 );
+
+    sm_del( sm );
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_set_object( sm, NULL, NULL, 0 ) == 1 );
+    TEST_ASSERT( sm_set_zeroed( sm, 0 ) == 0 );
+    sm_del( sm );
+}
+
+
+void test_zeroed_mixed( void )
+{
+    sm_t      sm;
+    my_slot_p ptr[ 4 * SLOT_CNT ];
+    my_slot_p slot;
+    int       i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_set_zeroed( sm, 0 ) == 1 );
+
+    /* Fresh slot taken with plain get is dirty after put. */
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        if ( i % 3 == 0 ) {
+            slot = sm_get( sm );
+            put_dirty( sm, slot );
+            ptr[ i ] = sm_get_zeroed( sm );
+            TEST_ASSERT( ptr[ i ] == slot );
+        } else {
+            ptr[ i ] = sm_get_zeroed( sm );
+        }
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+        ptr[ i ]->id = i + 1;
+    }
+
+    for ( i = 0; i < 4 * SLOT_CNT; i++ ) {
+        TEST_ASSERT( ptr[ i ]->id == (st_id_t)( i + 1 ) );
+    }
+
+    sm_del( sm );
+}
+
+
+void test_zeroed_idle( void )
+{
+    sm_t      sm;
+    my_slot_p ptr[ 2 * SLOT_CNT ];
+    st_size_t total;
+    int       n;
+    int       i;
+
+    sm = sm_new( SLOT_CNT, sizeof( my_slot_t ) );
+    TEST_ASSERT( sm_set_zeroed( sm, SM_ZERO_IDLE ) == 1 );
+
+    /* Fresh slots are not touched. */
+    sm_get_zeroed( sm );
+    TEST_ASSERT( sm_idle( sm ) == 0 );
+
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+    }
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        put_dirty( sm, ptr[ i ] );
+    }
+
+    total = sm_total_count( sm );
+
+    /* Clear all in batches. */
+    n = 0;
+    while ( sm_idle( sm ) ) {
+        n++;
+    }
+    TEST_ASSERT( n == ( 2 * SLOT_CNT + SM_ZERO_BATCH_CNT - 1 ) / SM_ZERO_BATCH_CNT );
+    TEST_ASSERT( sm_total_count( sm ) == total );
+
+    /* Cleared slots first. */
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        ptr[ i ] = sm_get_zeroed( sm );
+        TEST_ASSERT( is_zero( ptr[ i ], sizeof( my_slot_t ) ) );
+    }
+    TEST_ASSERT( sm_total_count( sm ) == total );
+
+    /* Cleared slots return to free list for plain get. */
+    for ( i = 0; i < 2 * SLOT_CNT; i++ ) {
+        put_dirty( sm, ptr[ i ] );
+    }
+    while ( sm_idle( sm ) ) {
+    }
+    for ( i = 0; i < (int)total - 1; i++ ) {
+        TEST_ASSERT( sm_get( sm ) != NULL );
+    }
+    TEST_ASSERT( sm_total_count( sm ) == total );
+    TEST_ASSERT( sm_free_count( sm ) == 0 );
+
+    sm_del( sm );
+}
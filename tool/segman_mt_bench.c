@@ -0,0 +1,660 @@
+/**
+ * @file   segman_mt_bench.c
+ *
+ * @brief  Multi-threaded scalability benchmark for Segman.
+ *
+ * Run 1..N threads through allocation patterns, over different ways
+ * of sharing Segman between threads, and over malloc. Throughput and
+ * per-operation latency percentiles are reported for each thread
+ * count. Latencies are sampled with the cycle counter (or ns clock,
+ * where cycle counter is not available).
+ *
+ * Patterns:
+ *   same   Each thread gets a batch of slots and puts them back.
+ *   cross  Each thread gets slots and passes them to the next thread,
+ *          which puts them (cross-thread frees).
+ *   burst  Each thread gets bursts of random size and puts them back,
+ *          so that the live set grows and shrinks in bursts.
+ *
+ * Backends:
+ *   mutex  One Segman, protected with a mutex.
+ *   pool   Segman per thread. Slots put by other threads are returned
+ *          to the owner through a lock-free list.
+ *   cpu    One Segman with per-CPU front end (sm_cpu_new()).
+ *   malloc malloc and free.
+ *
+ * Build:
+ *   gcc -O2 -Isrc tool/segman_mt_bench.c src/segman.c -lsixten -lpthread -o segman_mt_bench
+ *
+ * Usage:
+ *   segman_mt_bench [-t threads] [-n ops] [-s slot_size] [-B burst] [-p pattern] [-b backend]
+ *
+ *   -t  Maximum number of threads (default: number of CPUs).
+ *   -n  Number of slots per thread (default: 1000000).
+ *   -s  Slot size (default: 64).
+ *   -B  Maximum burst size (default: 4096).
+ *   -p  Pattern: same, cross, burst or all (default: all).
+ *   -b  Backend: mutex, pool, cpu, malloc or all (default: all).
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "segman.h"
+
+
+/** Slots in host Segment. */
+#define SLOT_CNT 4096
+
+/** Batch size of same-thread pattern. */
+#define BATCH_CNT 32
+
+/** Ring size of cross-thread pattern (power of 2). */
+#define RING_CNT 1024
+
+/** Latency sample rate (1 of SAMPLE_MASK+1 ops). */
+#define SAMPLE_MASK 0xf
+
+/** Histogram: 8 linear sub-buckets per power of 2. */
+#define HIST_SUB 3
+#define HIST_CNT ( 64 << HIST_SUB )
+
+
+enum { PAT_SAME, PAT_CROSS, PAT_BURST, PAT_CNT };
+enum { BE_MUTEX, BE_POOL, BE_CPU, BE_MALLOC, BE_CNT };
+
+static const char* pat_name[ PAT_CNT ] = { "same", "cross", "burst" };
+static const char* be_name[ BE_CNT ] = { "mutex", "pool", "cpu", "malloc" };
+
+
+/** Single producer, single consumer ring. */
+typedef struct
+{
+    st_t               slot[ RING_CNT ];
+    volatile st_size_t head __attribute__( ( aligned( 64 ) ) ); /**< Consumer. */
+    volatile st_size_t tail __attribute__( ( aligned( 64 ) ) ); /**< Producer. */
+} ring_t;
+
+
+typedef struct bench_s bench_t;
+
+/** Worker thread state. */
+typedef struct
+{
+    bench_t*  b;
+    st_size_t id;
+    pthread_t thread;
+    sm_t      sm;                /**< Own Segman (pool). */
+    st_t      remote;            /**< Slots put by others (pool). */
+    ring_t*   in;                /**< Incoming slots (cross). */
+    ring_t*   out;               /**< Outgoing slots (cross). */
+    st_t*     live;              /**< Live slots (same, burst). */
+    st_size_t op_cnt;            /**< Number of operations. */
+    uint32_t  seed;              /**< Burst size random seed. */
+    uint64_t  start;             /**< Start time (ns). */
+    uint64_t  end;               /**< End time (ns). */
+    uint64_t  hist[ HIST_CNT ];  /**< Latency histogram. */
+} __attribute__( ( aligned( 64 ) ) ) worker_t;
+
+
+/** Benchmark run. */
+struct bench_s
+{
+    st_size_t         pattern;
+    st_size_t         backend;
+    st_size_t         thread_cnt;
+    st_size_t         slot_cnt;   /**< Slots per thread. */
+    st_size_t         slot_size;
+    st_size_t         burst_max;
+    sm_t              sm;         /**< Shared Segman (mutex, cpu). */
+    sm_cpu_t          smc;        /**< Per-CPU front end (cpu). */
+    pthread_mutex_t   lock;       /**< Segman lock (mutex). */
+    pthread_barrier_t barrier;    /**< Start barrier. */
+    worker_t*         w;
+};
+
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+static inline uint64_t cycles( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+static uint64_t time_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static inline st_size_t hist_index( uint64_t v )
+{
+    st_size_t e;
+
+    if ( v < ( 1 << HIST_SUB ) ) {
+        return v;
+    }
+
+    e = 63 - __builtin_clzll( v );
+
+    return ( ( e - HIST_SUB + 1 ) << HIST_SUB ) + ( ( v >> ( e - HIST_SUB ) ) & ( ( 1 << HIST_SUB ) - 1 ) );
+}
+
+
+static uint64_t hist_value( st_size_t index )
+{
+    st_size_t e;
+
+    if ( index < ( 1 << HIST_SUB ) ) {
+        return index;
+    }
+
+    e = ( index >> HIST_SUB ) + HIST_SUB - 1;
+
+    return ( (uint64_t)1 << e ) + ( (uint64_t)( index & ( ( 1 << HIST_SUB ) - 1 ) ) << ( e - HIST_SUB ) );
+}
+
+
+/**
+ * Return latency at percentile (per mille).
+ */
+static uint64_t hist_percentile( uint64_t* hist, uint64_t total, st_size_t pm )
+{
+    uint64_t  sum;
+    uint64_t  limit;
+    st_size_t i;
+
+    limit = ( total * pm + 999 ) / 1000;
+    sum = 0;
+
+    for ( i = 0; i < HIST_CNT; i++ ) {
+        sum += hist[ i ];
+        if ( sum >= limit && sum > 0 ) {
+            return hist_value( i );
+        }
+    }
+
+    return 0;
+}
+
+
+static inline void relax( void )
+{
+    sched_yield();
+}
+
+
+
+/* ------------------------------------------------------------
+ * Backends:
+ */
+
+static inline st_t be_get( worker_t* w )
+{
+    bench_t* b;
+    st_t     slot;
+    st_t     next;
+
+    b = w->b;
+
+    switch ( b->backend ) {
+
+        case BE_MUTEX:
+            pthread_mutex_lock( &b->lock );
+            slot = sm_get( b->sm );
+            pthread_mutex_unlock( &b->lock );
+            return slot;
+
+        case BE_POOL:
+            if ( __atomic_load_n( &w->remote, __ATOMIC_RELAXED ) ) {
+                slot = __atomic_exchange_n( &w->remote, NULL, __ATOMIC_ACQUIRE );
+                for ( ; slot; slot = next ) {
+                    next = *( (st_p)slot );
+                    sm_put( w->sm, slot );
+                }
+            }
+            slot = sm_get( w->sm );
+            ( (st_id_t*)slot )[ 1 ] = w->id;
+            return slot;
+
+        case BE_CPU: return sm_cpu_get( b->smc );
+
+        default: return malloc( b->slot_size );
+    }
+}
+
+
+static inline void be_put( worker_t* w, st_t slot )
+{
+    bench_t*  b;
+    worker_t* owner;
+    st_t      head;
+
+    b = w->b;
+
+    switch ( b->backend ) {
+
+        case BE_MUTEX:
+            pthread_mutex_lock( &b->lock );
+            sm_put( b->sm, slot );
+            pthread_mutex_unlock( &b->lock );
+            break;
+
+        case BE_POOL:
+            owner = &b->w[ ( (st_id_t*)slot )[ 1 ] ];
+            if ( owner == w ) {
+                sm_put( w->sm, slot );
+            } else {
+                head = __atomic_load_n( &owner->remote, __ATOMIC_RELAXED );
+                do {
+                    *( (st_p)slot ) = head;
+                } while ( !__atomic_compare_exchange_n(
+                    &owner->remote, &head, slot, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+            }
+            break;
+
+        case BE_CPU: sm_cpu_put( b->smc, slot ); break;
+
+        default: free( slot ); break;
+    }
+}
+
+
+static inline st_t timed_get( worker_t* w )
+{
+    uint64_t t;
+    st_t     slot;
+
+    if ( ( w->op_cnt++ & SAMPLE_MASK ) == 0 ) {
+        t = cycles();
+        slot = be_get( w );
+        w->hist[ hist_index( cycles() - t ) ]++;
+    } else {
+        slot = be_get( w );
+    }
+
+    /* Touch beyond link and owner. */
+    ( (st_id_t*)slot )[ 2 ] = w->op_cnt;
+
+    return slot;
+}
+
+
+static inline void timed_put( worker_t* w, st_t slot )
+{
+    uint64_t t;
+
+    if ( ( w->op_cnt++ & SAMPLE_MASK ) == 0 ) {
+        t = cycles();
+        be_put( w, slot );
+        w->hist[ hist_index( cycles() - t ) ]++;
+    } else {
+        be_put( w, slot );
+    }
+}
+
+
+static void be_init( bench_t* b )
+{
+    st_size_t i;
+
+    switch ( b->backend ) {
+        case BE_MUTEX:
+            b->sm = sm_new( SLOT_CNT, b->slot_size );
+            pthread_mutex_init( &b->lock, NULL );
+            break;
+        case BE_POOL:
+            for ( i = 0; i < b->thread_cnt; i++ ) {
+                b->w[ i ].sm = sm_new( SLOT_CNT, b->slot_size );
+            }
+            break;
+        case BE_CPU:
+            b->sm = sm_new( SLOT_CNT, b->slot_size );
+            b->smc = sm_cpu_new( b->sm, 0 );
+            break;
+        default: break;
+    }
+}
+
+
+static void be_fini( bench_t* b )
+{
+    st_size_t i;
+
+    switch ( b->backend ) {
+        case BE_MUTEX:
+            sm_del( b->sm );
+            pthread_mutex_destroy( &b->lock );
+            break;
+        case BE_POOL:
+            /* Remote slots are released with the Segmans. */
+            for ( i = 0; i < b->thread_cnt; i++ ) {
+                sm_del( b->w[ i ].sm );
+            }
+            break;
+        case BE_CPU:
+            sm_cpu_del( b->smc );
+            sm_del( b->sm );
+            break;
+        default: break;
+    }
+}
+
+
+
+/* ------------------------------------------------------------
+ * Patterns:
+ */
+
+static void pat_same( worker_t* w )
+{
+    st_size_t done;
+    st_size_t i;
+
+    for ( done = 0; done < w->b->slot_cnt; done += BATCH_CNT ) {
+        for ( i = 0; i < BATCH_CNT; i++ ) {
+            w->live[ i ] = timed_get( w );
+        }
+        for ( i = BATCH_CNT; i > 0; i-- ) {
+            timed_put( w, w->live[ i - 1 ] );
+        }
+    }
+}
+
+
+static void pat_cross( worker_t* w )
+{
+    st_size_t produced;
+    st_size_t consumed;
+    st_size_t progress;
+    st_size_t pos;
+
+    produced = 0;
+    consumed = 0;
+
+    while ( produced < w->b->slot_cnt || consumed < w->b->slot_cnt ) {
+
+        progress = 0;
+
+        /* Produce while there is room. */
+        pos = w->out->tail;
+        while ( produced < w->b->slot_cnt
+                && pos - __atomic_load_n( &w->out->head, __ATOMIC_ACQUIRE ) < RING_CNT ) {
+            w->out->slot[ pos & ( RING_CNT - 1 ) ] = timed_get( w );
+            pos++;
+            __atomic_store_n( &w->out->tail, pos, __ATOMIC_RELEASE );
+            produced++;
+            progress++;
+        }
+
+        /* Consume all available. */
+        pos = w->in->head;
+        while ( pos != __atomic_load_n( &w->in->tail, __ATOMIC_ACQUIRE ) ) {
+            timed_put( w, w->in->slot[ pos & ( RING_CNT - 1 ) ] );
+            pos++;
+            __atomic_store_n( &w->in->head, pos, __ATOMIC_RELEASE );
+            consumed++;
+            progress++;
+        }
+
+        if ( progress == 0 ) {
+            relax();
+        }
+    }
+}
+
+
+static void pat_burst( worker_t* w )
+{
+    st_size_t done;
+    st_size_t cnt;
+    st_size_t i;
+
+    for ( done = 0; done < w->b->slot_cnt; done += cnt ) {
+        cnt = 1 + rand_r( &w->seed ) % w->b->burst_max;
+        for ( i = 0; i < cnt; i++ ) {
+            w->live[ i ] = timed_get( w );
+        }
+        for ( i = 0; i < cnt; i++ ) {
+            timed_put( w, w->live[ i ] );
+        }
+    }
+}
+
+
+static void* worker_main( void* arg )
+{
+    worker_t* w;
+
+    w = arg;
+
+    pthread_barrier_wait( &w->b->barrier );
+    w->start = time_ns();
+
+    switch ( w->b->pattern ) {
+        case PAT_SAME: pat_same( w ); break;
+        case PAT_CROSS: pat_cross( w ); break;
+        default: pat_burst( w ); break;
+    }
+
+    w->end = time_ns();
+
+    return NULL;
+}
+
+
+/**
+ * Run pattern over backend with given number of threads, and print
+ * result line.
+ */
+static void bench_run( bench_t* b )
+{
+    ring_t*   ring;
+    uint64_t  hist[ HIST_CNT ];
+    uint64_t  samples;
+    uint64_t  ops;
+    uint64_t  start;
+    uint64_t  end;
+    st_size_t live_cnt;
+    st_size_t i;
+    st_size_t j;
+
+    b->w = aligned_alloc( 64, b->thread_cnt * sizeof( worker_t ) );
+    memset( b->w, 0, b->thread_cnt * sizeof( worker_t ) );
+    ring = aligned_alloc( 64, b->thread_cnt * sizeof( ring_t ) );
+    memset( ring, 0, b->thread_cnt * sizeof( ring_t ) );
+
+    live_cnt = b->burst_max > BATCH_CNT ? b->burst_max : BATCH_CNT;
+
+    for ( i = 0; i < b->thread_cnt; i++ ) {
+        b->w[ i ].b = b;
+        b->w[ i ].id = i;
+        b->w[ i ].seed = i + 1;
+        b->w[ i ].in = &ring[ i ];
+        b->w[ i ].out = &ring[ ( i + 1 ) % b->thread_cnt ];
+        b->w[ i ].live = malloc( live_cnt * sizeof( st_t ) );
+    }
+
+    be_init( b );
+    pthread_barrier_init( &b->barrier, NULL, b->thread_cnt + 1 );
+
+    for ( i = 0; i < b->thread_cnt; i++ ) {
+        pthread_create( &b->w[ i ].thread, NULL, worker_main, &b->w[ i ] );
+    }
+
+    pthread_barrier_wait( &b->barrier );
+
+    for ( i = 0; i < b->thread_cnt; i++ ) {
+        pthread_join( b->w[ i ].thread, NULL );
+    }
+
+    memset( hist, 0, sizeof( hist ) );
+    samples = 0;
+    ops = 0;
+    start = UINT64_MAX;
+    end = 0;
+    for ( i = 0; i < b->thread_cnt; i++ ) {
+        /* From first start to last end. */
+        if ( b->w[ i ].start < start ) {
+            start = b->w[ i ].start;
+        }
+        if ( b->w[ i ].end > end ) {
+            end = b->w[ i ].end;
+        }
+        ops += b->w[ i ].op_cnt;
+        for ( j = 0; j < HIST_CNT; j++ ) {
+            hist[ j ] += b->w[ i ].hist[ j ];
+            samples += b->w[ i ].hist[ j ];
+        }
+    }
+
+    printf( "%-6s %-7s %4lu %10.2f %8lu %8lu %8lu %8lu %10lu\n",
+            pat_name[ b->pattern ],
+            be_name[ b->backend ],
+            (unsigned long)b->thread_cnt,
+            end > start ? (double)ops * 1000.0 / ( end - start ) : 0.0,
+            (unsigned long)hist_percentile( hist, samples, 500 ),
+            (unsigned long)hist_percentile( hist, samples, 900 ),
+            (unsigned long)hist_percentile( hist, samples, 990 ),
+            (unsigned long)hist_percentile( hist, samples, 999 ),
+            (unsigned long)hist_percentile( hist, samples, 1000 ) );
+    fflush( stdout );
+
+    pthread_barrier_destroy( &b->barrier );
+    be_fini( b );
+
+    for ( i = 0; i < b->thread_cnt; i++ ) {
+        free( b->w[ i ].live );
+    }
+    free( ring );
+    free( b->w );
+}
+
+
+static st_size_t find_name( const char** names, st_size_t cnt, const char* name )
+{
+    st_size_t i;
+
+    for ( i = 0; i < cnt; i++ ) {
+        if ( !strcmp( names[ i ], name ) ) {
+            return i;
+        }
+    }
+
+    return cnt;
+}
+
+
+
+int main( int argc, char** argv )
+{
+    bench_t   b;
+    st_size_t max_threads;
+    st_size_t pattern;
+    st_size_t backend;
+    st_size_t p;
+    st_size_t e;
+    st_size_t t;
+    int       opt;
+
+    memset( &b, 0, sizeof( b ) );
+    max_threads = sysconf( _SC_NPROCESSORS_ONLN );
+    b.slot_cnt = 1000000;
+    b.slot_size = 64;
+    b.burst_max = 4096;
+    pattern = PAT_CNT;
+    backend = BE_CNT;
+
+    while ( ( opt = getopt( argc, argv, "t:n:s:B:p:b:" ) ) != -1 ) {
+        switch ( opt ) {
+            case 't': max_threads = strtoul( optarg, NULL, 0 ); break;
+            case 'n': b.slot_cnt = strtoul( optarg, NULL, 0 ); break;
+            case 's': b.slot_size = strtoul( optarg, NULL, 0 ); break;
+            case 'B': b.burst_max = strtoul( optarg, NULL, 0 ); break;
+            case 'p':
+                if ( strcmp( optarg, "all" ) ) {
+                    pattern = find_name( pat_name, PAT_CNT, optarg );
+                    if ( pattern == PAT_CNT ) {
+                        fprintf( stderr, "segman_mt_bench: unknown pattern \"%s\"\n", optarg );
+                        return 1;
+                    }
+                }
+                break;
+            case 'b':
+                if ( strcmp( optarg, "all" ) ) {
+                    backend = find_name( be_name, BE_CNT, optarg );
+                    if ( backend == BE_CNT ) {
+                        fprintf( stderr, "segman_mt_bench: unknown backend \"%s\"\n", optarg );
+                        return 1;
+                    }
+                }
+                break;
+            default:
+                fprintf( stderr,
+                         "usage: %s [-t threads] [-n ops] [-s slot_size] [-B burst] "
+                         "[-p pattern] [-b backend]\n",
+                         argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    /* Link, owner and touched word. */
+    if ( b.slot_size < 3 * sizeof( st_t ) ) {
+        b.slot_size = 3 * sizeof( st_t );
+    }
+
+    if ( max_threads < 1 ) {
+        max_threads = 1;
+    }
+
+    if ( b.burst_max < 1 ) {
+        b.burst_max = 1;
+    }
+
+    printf( "%-6s %-7s %4s %10s %8s %8s %8s %8s %10s\n",
+            "# pat", "backend", "thr", "Mops/s", "p50", "p90", "p99", "p99.9", "max" );
+
+    for ( p = 0; p < PAT_CNT; p++ ) {
+        if ( pattern != PAT_CNT && pattern != p ) {
+            continue;
+        }
+        for ( e = 0; e < BE_CNT; e++ ) {
+            if ( backend != BE_CNT && backend != e ) {
+                continue;
+            }
+            b.pattern = p;
+            b.backend = e;
+            /* Powers of two, and the maximum. */
+            for ( t = 1;; t *= 2 ) {
+                b.thread_cnt = t < max_threads ? t : max_threads;
+                bench_run( &b );
+                if ( b.thread_cnt == max_threads ) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
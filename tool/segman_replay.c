@@ -0,0 +1,355 @@
+/**
+ * @file   segman_replay.c
+ *
+ * @brief  Replay Segman allocation trace.
+ *
+ * Drive a fresh Segman (or malloc) with the get/put events of a trace
+ * recorded with sm_trace_start(). Use this to compare pool settings
+ * against a real allocation pattern.
+ *
+ * Build:
+ *   gcc -O2 -Isrc tool/segman_replay.c src/segman.c -lsixten -lpthread -o segman_replay
+ *
+ * Usage:
+ *   segman_replay [-m] [-c slot_cnt] [-b block_size] [-r resize] [-n rounds] trace
+ *
+ *   -m  Use malloc instead of Segman.
+ *   -c  Slots in host Segment (default: 1024).
+ *   -b  Block size (Block mode, overrides -c).
+ *   -r  Resize factor percentage (default: 100).
+ *   -n  Number of replay rounds (default: 1).
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "segman.h"
+
+
+/** Live slots of traced Segment. */
+typedef struct
+{
+    st_t*     slot; /**< Replay slots by trace slot index. */
+    st_size_t size; /**< Table size. */
+} seg_tab_t;
+
+
+/** Replay state. */
+typedef struct
+{
+    sm_trace_ev_s* ev;        /**< Events. */
+    st_size_t      ev_cnt;    /**< Number of events. */
+    st_size_t      slot_size; /**< Traced slot size. */
+    st_size_t      clock;     /**< Trace time unit. */
+    seg_tab_t*     seg;       /**< Live slots by trace Segment. */
+    st_size_t      seg_cnt;   /**< Number of Segment tables. */
+} replay_t;
+
+
+/**
+ * Read all trace chunks to memory.
+ *
+ * @param rp   Replay.
+ * @param file Trace file name.
+ *
+ * @return 1 on success (0 on failure).
+ */
+static int replay_read( replay_t* rp, const char* file )
+{
+    FILE*          fh;
+    sm_trace_hdr_s hdr;
+    st_size_t      size;
+
+    fh = fopen( file, "rb" );
+    if ( fh == NULL ) {
+        return 0;
+    }
+
+    size = 0;
+    while ( fread( &hdr, sizeof( hdr ), 1, fh ) == 1 ) {
+
+        if ( hdr.magic != SM_TRACE_MAGIC ) {
+            fclose( fh );
+            return 0;
+        }
+
+        rp->slot_size = hdr.slot_size;
+        rp->clock = hdr.clock;
+
+        if ( rp->ev_cnt + hdr.ev_cnt > size ) {
+            size = 2 * ( rp->ev_cnt + hdr.ev_cnt );
+            rp->ev = realloc( rp->ev, size * sizeof( sm_trace_ev_s ) );
+        }
+
+        if ( fread( rp->ev + rp->ev_cnt, sizeof( sm_trace_ev_s ), hdr.ev_cnt, fh )
+             != hdr.ev_cnt ) {
+            fclose( fh );
+            return 0;
+        }
+
+        rp->ev_cnt += hdr.ev_cnt;
+    }
+
+    fclose( fh );
+
+    return 1;
+}
+
+
+/**
+ * Return live slot entry of traced slot. Tables are extended as
+ * needed.
+ *
+ * @param rp    Replay.
+ * @param seg   Trace Segment number.
+ * @param index Trace slot index.
+ *
+ * @return Entry.
+ */
+static st_t* replay_slot( replay_t* rp, uint32_t seg, uint32_t index )
+{
+    seg_tab_t* tab;
+    st_size_t  size;
+
+    if ( seg >= rp->seg_cnt ) {
+        size = 2 * ( seg + 1 );
+        rp->seg = realloc( rp->seg, size * sizeof( seg_tab_t ) );
+        memset( rp->seg + rp->seg_cnt, 0, ( size - rp->seg_cnt ) * sizeof( seg_tab_t ) );
+        rp->seg_cnt = size;
+    }
+
+    tab = &rp->seg[ seg ];
+
+    if ( index >= tab->size ) {
+        size = 2 * ( index + 1 );
+        tab->slot = realloc( tab->slot, size * sizeof( st_t ) );
+        memset( tab->slot + tab->size, 0, ( size - tab->size ) * sizeof( st_t ) );
+        tab->size = size;
+    }
+
+    return &tab->slot[ index ];
+}
+
+
+/**
+ * Return monotonic time in nanoseconds.
+ *
+ * @return Time.
+ */
+static uint64_t replay_time( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+int main( int argc, char** argv )
+{
+    replay_t       rp;
+    sm_t           sm;
+    sm_tail_t      cur;
+    sm_trace_ev_t  ev;
+    st_t*          ref;
+    int            use_malloc;
+    st_size_t      slot_cnt;
+    st_size_t      block_size;
+    st_size_t      resize;
+    st_size_t      rounds;
+    st_size_t      round;
+    st_size_t      op_cnt;
+    st_size_t      live;
+    st_size_t      peak;
+    st_size_t      seg_cnt;
+    st_size_t      header;
+    st_size_t      i;
+    uint64_t       start;
+    uint64_t       elapsed;
+    int            opt;
+
+    use_malloc = 0;
+    slot_cnt = 1024;
+    block_size = 0;
+    resize = 100;
+    rounds = 1;
+
+    while ( ( opt = getopt( argc, argv, "mc:b:r:n:" ) ) != -1 ) {
+        switch ( opt ) {
+            case 'm': use_malloc = 1; break;
+            case 'c': slot_cnt = strtoul( optarg, NULL, 0 ); break;
+            case 'b': block_size = strtoul( optarg, NULL, 0 ); break;
+            case 'r': resize = strtoul( optarg, NULL, 0 ); break;
+            case 'n': rounds = strtoul( optarg, NULL, 0 ); break;
+            default:
+                fprintf( stderr,
+                         "usage: %s [-m] [-c slot_cnt] [-b block_size] [-r resize] "
+                         "[-n rounds] trace\n",
+                         argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( optind >= argc ) {
+        fprintf( stderr, "segman_replay: trace file missing\n" );
+        return 1;
+    }
+
+    memset( &rp, 0, sizeof( rp ) );
+
+    if ( !replay_read( &rp, argv[ optind ] ) || rp.ev_cnt == 0 ) {
+        fprintf( stderr, "segman_replay: invalid trace \"%s\"\n", argv[ optind ] );
+        return 1;
+    }
+
+    sm = NULL;
+    if ( !use_malloc ) {
+        /* Segman asserts its geometry, hence check it first. */
+        if ( rp.slot_size < sizeof( st_t ) ) {
+            fprintf( stderr,
+                     "segman_replay: traced slot size %lu too small\n",
+                     (unsigned long)rp.slot_size );
+            return 1;
+        }
+        if ( block_size ) {
+            header = ( sizeof( sm_s ) + rp.slot_size - 1 ) / rp.slot_size * rp.slot_size;
+            if ( block_size < header + SM_MIN_SLOT_CNT * rp.slot_size ) {
+                fprintf( stderr,
+                         "segman_replay: block size %lu too small\n",
+                         (unsigned long)block_size );
+                return 1;
+            }
+            sm = sm_new_block( block_size, rp.slot_size );
+        } else {
+            if ( slot_cnt < SM_MIN_SLOT_CNT ) {
+                fprintf( stderr,
+                         "segman_replay: slot count %lu too small\n",
+                         (unsigned long)slot_cnt );
+                return 1;
+            }
+            sm = sm_new( slot_cnt, rp.slot_size );
+        }
+        if ( sm == NULL ) {
+            fprintf( stderr, "segman_replay: out of memory\n" );
+            return 1;
+        }
+        if ( sm_set_resize_factor( sm, resize ) == 0 ) {
+            fprintf( stderr,
+                     "segman_replay: invalid resize factor %lu\n",
+                     (unsigned long)resize );
+            return 1;
+        }
+    }
+
+    /* Touch all tables, so that replay rounds measure allocation. */
+    for ( i = 0; i < rp.ev_cnt; i++ ) {
+        if ( rp.ev[ i ].seg != UINT32_MAX ) {
+            replay_slot( &rp, rp.ev[ i ].seg, rp.ev[ i ].index );
+        }
+    }
+
+    op_cnt = 0;
+    live = 0;
+    peak = 0;
+    elapsed = 0;
+
+    for ( round = 0; round < rounds; round++ ) {
+
+        start = replay_time();
+
+        for ( i = 0; i < rp.ev_cnt; i++ ) {
+
+            ev = &rp.ev[ i ];
+
+            if ( ev->seg == UINT32_MAX ) {
+                continue;
+            }
+
+            ref = &rp.seg[ ev->seg ].slot[ ev->index ];
+
+            switch ( SM_TRACE_TYPE( ev ) ) {
+
+                case SM_TRACE_GET:
+                    if ( *ref ) {
+                        /* Put missing from trace. */
+                        continue;
+                    }
+                    *ref = use_malloc ? malloc( rp.slot_size ) : sm_get( sm );
+                    op_cnt++;
+                    if ( ++live > peak ) {
+                        peak = live;
+                    }
+                    break;
+
+                case SM_TRACE_PUT:
+                    if ( *ref == NULL ) {
+                        /* Get missing from trace. */
+                        continue;
+                    }
+                    if ( use_malloc ) {
+                        free( *ref );
+                    } else {
+                        sm_put( sm, *ref );
+                    }
+                    *ref = NULL;
+                    op_cnt++;
+                    live--;
+                    break;
+
+                default: break;
+            }
+        }
+
+        /* Release the rest before next round. */
+        for ( i = 0; i < rp.seg_cnt; i++ ) {
+            st_size_t j;
+            for ( j = 0; j < rp.seg[ i ].size; j++ ) {
+                if ( rp.seg[ i ].slot[ j ] ) {
+                    if ( use_malloc ) {
+                        free( rp.seg[ i ].slot[ j ] );
+                    } else {
+                        sm_put( sm, rp.seg[ i ].slot[ j ] );
+                    }
+                    rp.seg[ i ].slot[ j ] = NULL;
+                    op_cnt++;
+                    live--;
+                }
+            }
+        }
+
+        elapsed += replay_time() - start;
+    }
+
+    printf( "allocator:  %s\n", use_malloc ? "malloc" : "segman" );
+    printf( "slot_size:  %lu\n", (unsigned long)rp.slot_size );
+    printf( "clock:      %s\n", rp.clock == SM_TRACE_CLOCK_TSC ? "tsc" : "ns" );
+    printf( "events:     %lu\n", (unsigned long)rp.ev_cnt );
+    printf( "operations: %lu\n", (unsigned long)op_cnt );
+    printf( "peak_live:  %lu\n", (unsigned long)peak );
+    printf( "time_ns:    %lu\n", (unsigned long)elapsed );
+    printf( "ns_per_op:  %.2f\n", op_cnt ? (double)elapsed / op_cnt : 0.0 );
+
+    if ( sm ) {
+        seg_cnt = 0;
+        for ( cur = &sm->host; cur; cur = cur->next ) {
+            seg_cnt++;
+        }
+        printf( "segments:   %lu\n", (unsigned long)seg_cnt );
+        printf( "total_cnt:  %lu\n", (unsigned long)sm_total_count( sm ) );
+        sm_del( sm );
+    }
+
+    for ( i = 0; i < rp.seg_cnt; i++ ) {
+        free( rp.seg[ i ].slot );
+    }
+    free( rp.seg );
+    free( rp.ev );
+
+    return 0;
+}
@@ -0,0 +1,434 @@
+/**
+ * @file   smcont_bench.c
+ *
+ * @brief  Benchmark Segman backed containers against malloc.
+ *
+ * Run the same hash map and list workloads with smcont containers
+ * and with equivalent containers, whose nodes are allocated with
+ * malloc. Lookups are done in random order, after half of the nodes
+ * have been removed and re-inserted in another random order.
+ *
+ * Build:
+ *   gcc -O2 -Isrc tool/smcont_bench.c src/smcont.c src/segman.c -lsixten -lpthread -o smcont_bench
+ *
+ * Usage:
+ *   smcont_bench [-n node_cnt] [-s node_size] [-r rounds]
+ *
+ *   -n  Number of nodes (default: 1000000).
+ *   -s  Node size in bytes (default: 64).
+ *   -r  Number of rounds (default: 3).
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "smcont.h"
+
+
+/** Benchmark node, common header for both node types. */
+typedef struct bench_node_s
+{
+    union
+    {
+        smh_node_s h;
+        sml_node_s l;
+        struct
+        {
+            struct bench_node_s* next;
+            struct bench_node_s* prev;
+        };
+    };
+    uint64_t key;
+} bench_node_t;
+
+
+/** Malloc backed chained hash map. */
+typedef struct
+{
+    bench_node_t** bucket;
+    st_size_t      bucket_cnt;
+    st_size_t      cnt;
+} mh_t;
+
+
+/** Benchmark settings. */
+typedef struct
+{
+    st_size_t node_cnt;
+    st_size_t node_size;
+    uint64_t* order;
+    uint64_t* lookup;
+} bench_t;
+
+
+/** Phase names. */
+static const char* phase_name[] = { "insert", "churn", "lookup", "remove", "list" };
+
+#define PHASE_CNT 5
+
+
+
+/* ------------------------------------------------------------
+ * Support:
+ */
+
+static uint64_t bench_time( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static st_size_t key_hash( st_t key )
+{
+    return *( (uint64_t*)key ) * 0x9e3779b97f4a7c15ULL;
+}
+
+
+static st_size_t key_eq( st_t node, st_t key )
+{
+    return ( (bench_node_t*)node )->key == *( (uint64_t*)key );
+}
+
+
+static mh_t* mh_new( void )
+{
+    mh_t* h;
+
+    h = malloc( sizeof( mh_t ) );
+    h->bucket_cnt = SMH_MIN_BUCKET_CNT;
+    h->bucket = calloc( h->bucket_cnt, sizeof( bench_node_t* ) );
+    h->cnt = 0;
+
+    return h;
+}
+
+
+static void mh_insert( mh_t* h, bench_node_t* node )
+{
+    bench_node_t** bucket;
+    bench_node_t*  cur;
+    bench_node_t*  next;
+    st_size_t      i;
+
+    node->h.hash = key_hash( &node->key );
+    bucket = &h->bucket[ node->h.hash & ( h->bucket_cnt - 1 ) ];
+    node->next = *bucket;
+    *bucket = node;
+
+    if ( ++h->cnt > h->bucket_cnt ) {
+        bucket = calloc( 2 * h->bucket_cnt, sizeof( bench_node_t* ) );
+        for ( i = 0; i < h->bucket_cnt; i++ ) {
+            for ( cur = h->bucket[ i ]; cur; cur = next ) {
+                next = cur->next;
+                cur->next = bucket[ cur->h.hash & ( 2 * h->bucket_cnt - 1 ) ];
+                bucket[ cur->h.hash & ( 2 * h->bucket_cnt - 1 ) ] = cur;
+            }
+        }
+        free( h->bucket );
+        h->bucket = bucket;
+        h->bucket_cnt *= 2;
+    }
+}
+
+
+static bench_node_t* mh_find( mh_t* h, uint64_t key )
+{
+    bench_node_t* cur;
+    st_size_t     hash;
+
+    hash = key_hash( &key );
+    for ( cur = h->bucket[ hash & ( h->bucket_cnt - 1 ) ]; cur; cur = cur->next ) {
+        if ( cur->h.hash == hash && cur->key == key ) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+
+static bench_node_t* mh_remove( mh_t* h, uint64_t key )
+{
+    bench_node_t** ref;
+    bench_node_t*  cur;
+    st_size_t      hash;
+
+    hash = key_hash( &key );
+    for ( ref = &h->bucket[ hash & ( h->bucket_cnt - 1 ) ]; *ref; ref = &( *ref )->next ) {
+        cur = *ref;
+        if ( cur->h.hash == hash && cur->key == key ) {
+            *ref = cur->next;
+            h->cnt--;
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void mh_del( mh_t* h )
+{
+    free( h->bucket );
+    free( h );
+}
+
+
+
+/* ------------------------------------------------------------
+ * Workloads:
+ */
+
+/**
+ * Run workload phases with smcont containers.
+ *
+ * @param b    Settings.
+ * @param time Phase times.
+ *
+ * @return Checksum.
+ */
+static uint64_t run_smcont( bench_t* b, uint64_t* time )
+{
+    smh_t         h;
+    sml_t         l;
+    bench_node_t* node;
+    uint64_t      sum;
+    uint64_t      start;
+    st_size_t     i;
+
+    sum = 0;
+    h = smh_new( b->node_size, SMH_MIN_BUCKET_CNT, key_hash, key_eq );
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        node = smh_node_get( h );
+        node->key = i;
+        smh_insert( h, node, &node->key );
+    }
+    time[ 0 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i += 2 ) {
+        smh_node_put( h, smh_remove( h, &b->order[ i ] ) );
+    }
+    for ( i = 0; i < b->node_cnt; i += 2 ) {
+        node = smh_node_get( h );
+        node->key = b->order[ i ];
+        smh_insert( h, node, &node->key );
+    }
+    time[ 1 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        sum += ( (bench_node_t*)smh_find( h, &b->lookup[ i ] ) )->key;
+    }
+    time[ 2 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        smh_node_put( h, smh_remove( h, &b->order[ i ] ) );
+    }
+    time[ 3 ] += bench_time() - start;
+
+    smh_del( h );
+
+    l = sml_new( b->node_size, SMH_MIN_BUCKET_CNT );
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        node = sml_node_get( l );
+        node->key = i;
+        sml_push_back( l, node );
+    }
+    for ( node = sml_first( l ); node; node = node->next ) {
+        sum += node->key;
+    }
+    while ( ( node = sml_pop_front( l ) ) ) {
+        sml_node_put( l, node );
+    }
+    time[ 4 ] += bench_time() - start;
+
+    sml_del( l );
+
+    return sum;
+}
+
+
+/**
+ * Run workload phases with malloc backed containers.
+ *
+ * @param b    Settings.
+ * @param time Phase times.
+ *
+ * @return Checksum.
+ */
+static uint64_t run_malloc( bench_t* b, uint64_t* time )
+{
+    mh_t*         h;
+    bench_node_t* node;
+    bench_node_t* first;
+    bench_node_t* last;
+    uint64_t      sum;
+    uint64_t      start;
+    st_size_t     i;
+
+    sum = 0;
+    h = mh_new();
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        node = malloc( b->node_size );
+        node->key = i;
+        mh_insert( h, node );
+    }
+    time[ 0 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i += 2 ) {
+        free( mh_remove( h, b->order[ i ] ) );
+    }
+    for ( i = 0; i < b->node_cnt; i += 2 ) {
+        node = malloc( b->node_size );
+        node->key = b->order[ i ];
+        mh_insert( h, node );
+    }
+    time[ 1 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        sum += mh_find( h, b->lookup[ i ] )->key;
+    }
+    time[ 2 ] += bench_time() - start;
+
+    start = bench_time();
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        free( mh_remove( h, b->order[ i ] ) );
+    }
+    time[ 3 ] += bench_time() - start;
+
+    mh_del( h );
+
+    start = bench_time();
+    first = NULL;
+    last = NULL;
+    for ( i = 0; i < b->node_cnt; i++ ) {
+        node = malloc( b->node_size );
+        node->key = i;
+        node->next = NULL;
+        node->prev = last;
+        if ( last ) {
+            last->next = node;
+        } else {
+            first = node;
+        }
+        last = node;
+    }
+    for ( node = first; node; node = node->next ) {
+        sum += node->key;
+    }
+    while ( first ) {
+        node = first;
+        first = node->next;
+        if ( first ) {
+            first->prev = NULL;
+        }
+        free( node );
+    }
+    time[ 4 ] += bench_time() - start;
+
+    return sum;
+}
+
+
+
+int main( int argc, char** argv )
+{
+    bench_t   b;
+    uint64_t  sm_time[ PHASE_CNT ];
+    uint64_t  ma_time[ PHASE_CNT ];
+    uint64_t  sm_sum;
+    uint64_t  ma_sum;
+    uint64_t  tmp;
+    st_size_t rounds;
+    st_size_t round;
+    st_size_t i;
+    st_size_t j;
+    int       opt;
+
+    b.node_cnt = 1000000;
+    b.node_size = 64;
+    rounds = 3;
+
+    while ( ( opt = getopt( argc, argv, "n:s:r:" ) ) != -1 ) {
+        switch ( opt ) {
+            case 'n': b.node_cnt = strtoul( optarg, NULL, 0 ); break;
+            case 's': b.node_size = strtoul( optarg, NULL, 0 ); break;
+            case 'r': rounds = strtoul( optarg, NULL, 0 ); break;
+            default:
+                fprintf( stderr, "usage: %s [-n node_cnt] [-s node_size] [-r rounds]\n", argv[ 0 ] );
+                return 1;
+        }
+    }
+
+    if ( b.node_size < sizeof( bench_node_t ) ) {
+        b.node_size = sizeof( bench_node_t );
+    }
+
+    /* Random key orders, separate for lookups. */
+    b.order = malloc( b.node_cnt * sizeof( uint64_t ) );
+    b.lookup = malloc( b.node_cnt * sizeof( uint64_t ) );
+    for ( i = 0; i < b.node_cnt; i++ ) {
+        b.order[ i ] = i;
+        b.lookup[ i ] = i;
+    }
+    srand( 1 );
+    for ( i = b.node_cnt - 1; i > 0; i-- ) {
+        j = rand() % ( i + 1 );
+        tmp = b.order[ i ];
+        b.order[ i ] = b.order[ j ];
+        b.order[ j ] = tmp;
+        j = rand() % ( i + 1 );
+        tmp = b.lookup[ i ];
+        b.lookup[ i ] = b.lookup[ j ];
+        b.lookup[ j ] = tmp;
+    }
+
+    memset( sm_time, 0, sizeof( sm_time ) );
+    memset( ma_time, 0, sizeof( ma_time ) );
+    sm_sum = 0;
+    ma_sum = 0;
+
+    for ( round = 0; round < rounds; round++ ) {
+        sm_sum += run_smcont( &b, sm_time );
+        ma_sum += run_malloc( &b, ma_time );
+    }
+
+    if ( sm_sum != ma_sum ) {
+        fprintf( stderr, "smcont_bench: checksum mismatch\n" );
+        return 1;
+    }
+
+    printf( "nodes:      %lu\n", (unsigned long)b.node_cnt );
+    printf( "node_size:  %lu\n", (unsigned long)b.node_size );
+    printf( "%-10s  %12s  %12s\n", "ns/op", "smcont", "malloc" );
+    for ( i = 0; i < PHASE_CNT; i++ ) {
+        printf( "%-10s  %12.2f  %12.2f\n",
+                phase_name[ i ],
+                (double)sm_time[ i ] / ( rounds * b.node_cnt ),
+                (double)ma_time[ i ] / ( rounds * b.node_cnt ) );
+    }
+
+    free( b.order );
+    free( b.lookup );
+
+    return 0;
+}